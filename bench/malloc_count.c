@@ -0,0 +1,58 @@
+/* LD_PRELOAD shim that counts calls into the allocator and reports them on
+ * stderr when the program exits.
+ *
+ * cc -shared -fPIC -o malloc_count.so bench/malloc_count.c
+ */
+#define _GNU_SOURCE
+#include <stddef.h>
+#include <stdio.h>
+#include <unistd.h>
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void __libc_free(void *ptr);
+
+static unsigned long n_malloc, n_calloc, n_realloc, n_free;
+
+void *
+malloc(size_t size)
+{
+  ++n_malloc;
+  return __libc_malloc(size);
+}
+
+void *
+calloc(size_t nmemb, size_t size)
+{
+  ++n_calloc;
+  return __libc_calloc(nmemb, size);
+}
+
+void *
+realloc(void *ptr, size_t size)
+{
+  ++n_realloc;
+  return __libc_realloc(ptr, size);
+}
+
+void
+free(void *ptr)
+{
+  if (ptr) ++n_free;
+  __libc_free(ptr);
+}
+
+__attribute__((destructor)) static void
+report(void)
+{
+  char buf[160];
+  int n = snprintf(buf,
+                   sizeof buf,
+                   "malloc_count: malloc=%lu calloc=%lu realloc=%lu free=%lu\n",
+                   n_malloc,
+                   n_calloc,
+                   n_realloc,
+                   n_free);
+  write(STDERR_FILENO, buf, n);
+}
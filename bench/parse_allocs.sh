@@ -0,0 +1,30 @@
+#!/bin/sh
+# Counts allocator calls per parsed line for release/bigshell and the
+# reference implementation, on a generated corpus of command lines that
+# exercise words, quoting, assignments and redirections.
+#
+# Every line is a `cd` with too many arguments, so executing it is a cheap
+# error path and the counts are dominated by reading and parsing.
+#
+# usage: bench/parse_allocs.sh [lines [shell...]]
+set -e
+n=${1:-20000}
+[ $# -gt 0 ] && shift
+[ $# -gt 0 ] || set -- release/bigshell reference/bigshell
+tmp=$(mktemp -d)
+trap 'rm -rf "$tmp"' EXIT
+
+cc -O2 -shared -fPIC -o "$tmp/malloc_count.so" bench/malloc_count.c
+awk -v n="$n" 'BEGIN {
+  for (i = 0; i < n; ++i)
+    printf "A=%d B=\"x y\" cd word%d \"quoted %d\" '\''single'\'' a\\ b 2>/dev/null <&0 >&2 ; cd x y z 2>/dev/null\n", i, i, i
+}' >"$tmp/corpus"
+
+for shell in "$@"; do
+  LD_PRELOAD="$tmp/malloc_count.so" "$shell" <"$tmp/corpus" 2>&1 >/dev/null |
+    awk -v n="$n" -v sh="$shell" '/^malloc_count:/ {
+      total = 0
+      for (i = 2; i <= NF; ++i) { split($i, kv, "="); if (kv[1] != "free") total += kv[2] }
+      printf "%-20s %8d lines %10d allocations %8.2f per line\n", sh, n, total, total / n
+    }'
+done
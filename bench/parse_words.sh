@@ -0,0 +1,29 @@
+#!/bin/sh
+# Times parsing (and expanding) command lines of 10, 1k and 100k words.
+#
+# Each run feeds about a million words to the shell, as lines of the given
+# length. Every line is a `cd` with too many arguments, so executing it is a
+# cheap error path.
+#
+# usage: bench/parse_words.sh [shell...]
+set -e
+[ $# -gt 0 ] || set -- release/bigshell reference/bigshell
+tmp=$(mktemp -d)
+trap 'rm -rf "$tmp"' EXIT
+
+for words in 10 1000 100000; do
+  awk -v w="$words" 'BEGIN {
+    for (l = 0; l < 1000000 / w; ++l) {
+      printf "cd"
+      for (i = 0; i < w; ++i) printf " word%d", i
+      printf " 2>/dev/null\n"
+    }
+  }' >"$tmp/corpus"
+  for shell in "$@"; do
+    start=$(date +%s.%N)
+    "$shell" <"$tmp/corpus" >/dev/null 2>&1 || :
+    end=$(date +%s.%N)
+    awk -v s="$start" -v e="$end" -v w="$words" -v sh="$shell" \
+      'BEGIN { printf "%-20s %6d words/line %8.3fs %10.0f words/s\n", sh, w, e - s, 1000000 / (e - s) }'
+  done
+done
@@ -0,0 +1,19 @@
+#!/bin/sh
+# Compares external command throughput of release/bigshell, which starts
+# commands with posix_spawn(), against reference/bigshell, which always uses
+# fork() + execvp().
+#
+# usage: bench/spawn.sh [commands]
+set -e
+n=${1:-5000}
+script=$(mktemp)
+trap 'rm -f "$script"' EXIT
+yes true | head -n "$n" >"$script"
+
+for shell in release/bigshell reference/bigshell; do
+  start=$(date +%s.%N)
+  "$shell" <"$script" >/dev/null
+  end=$(date +%s.%N)
+  awk -v s="$start" -v e="$end" -v n="$n" -v sh="$shell" \
+    'BEGIN { printf "%-20s %8d commands %8.3fs %10.0f commands/s\n", sh, n, e - s, n / (e - s) }'
+done
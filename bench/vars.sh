@@ -0,0 +1,31 @@
+#!/bin/sh
+# Times setting and reading 10k shell variables.
+#
+# The script assigns V0..V9999, then reads every one of them back ten times,
+# a hundred at a time, as arguments to a `cd` with too many arguments (a
+# cheap builtin error path, so no processes are started).
+#
+# usage: bench/vars.sh [shell...]
+set -e
+[ $# -gt 0 ] || set -- release/bigshell reference/bigshell
+tmp=$(mktemp -d)
+trap 'rm -rf "$tmp"' EXIT
+
+awk 'BEGIN {
+  for (i = 0; i < 10000; ++i) printf "V%d=value%d\n", i, i
+  for (r = 0; r < 10; ++r) {
+    for (i = 0; i < 10000; i += 100) {
+      printf "cd"
+      for (j = i; j < i + 100; ++j) printf " $V%d", j
+      printf " 2>/dev/null\n"
+    }
+  }
+}' >"$tmp/corpus"
+
+for shell in "$@"; do
+  start=$(date +%s.%N)
+  "$shell" <"$tmp/corpus" >/dev/null 2>&1 || :
+  end=$(date +%s.%N)
+  awk -v s="$start" -v e="$end" -v sh="$shell" \
+    'BEGIN { printf "%-20s 10000 sets 100000 reads %8.3fs\n", sh, e - s }'
+done
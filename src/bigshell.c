@@ -13,6 +13,7 @@
 #include "params.h"
 #include "parser.h"
 #include "runner.h"
+#include "script.h"
 #include "signal.h"
 #include "util/gprintf.h"
 #include "wait.h"
@@ -39,11 +40,14 @@ prompt:
     
     /* BGDID Enable this line once you've implemented the function */
     if (signal_enable_interrupt(SIGINT) < 0) goto err;
+    /* Let finished background jobs be reported while waiting for input */
+    if (is_interactive && signal_sigchld_interrupt(1) < 0) goto err;
     
     int res = command_list_parse(&cl, stdin);
     
     /* BGDID Enable this line once you've implemented the function */
     if (signal_ignore(SIGINT) < 0) goto err;
+    if (is_interactive && signal_sigchld_interrupt(0) < 0) goto err;
 
     if (res == -1) { /* System library errors */
       switch (errno) { /* Handle specific errors */
@@ -60,7 +64,7 @@ prompt:
       errno = 0;
       goto prompt;
     } else if (res == 0) { /* No commands parsed */
-      if (feof(stdin)) bigshell_exit(); /* Exit on eof */
+      if (feof(stdin) || script_eof()) bigshell_exit(); /* Exit on eof */
       goto prompt; /* Blank line */
     } else {
       gprintf("Parsed command list to execute:");
@@ -8,6 +8,7 @@
 #include <unistd.h>
 
 #include "builtins.h"
+#include "cmdhash.h"
 #include "exit.h"
 #include "jobs.h"
 #include "params.h"
@@ -307,6 +308,53 @@ builtin_jobs(struct command *cmd, struct builtin_redir const *redir_list)
   return 0;
 }
 
+static int
+print_hashed_command(char const *name,
+                     char const *path,
+                     unsigned long hits,
+                     void *arg)
+{
+  dprintf(*(int *)arg, "%4lu\t%s\n", hits, path);
+  return 0;
+}
+
+/** remembers or lists the locations of commands
+ *
+ * @returns 0 on success, -1 if any name was not found
+ *
+ * hash [-r] [name...]
+ *
+ * With no arguments, lists the remembered commands. -r forgets every
+ * remembered location. Each name is searched for in $PATH and remembered.
+ */
+static int
+builtin_hash(struct command *cmd, struct builtin_redir const *redir_list)
+{
+  size_t i = 1;
+  if (i < cmd->word_count && strcmp(cmd->words[i], "-r") == 0) {
+    cmdhash_flush();
+    ++i;
+  }
+
+  if (cmd->word_count == 1) {
+    int fd = get_pseudo_fd(redir_list, STDOUT_FILENO);
+    dprintf(fd, "hits\tcommand\n");
+    cmdhash_foreach(print_hashed_command, &fd);
+    return 0;
+  }
+
+  int status = 0;
+  for (; i < cmd->word_count; ++i) {
+    if (!cmdhash_lookup(cmd->words[i])) {
+      dprintf(get_pseudo_fd(redir_list, STDERR_FILENO),
+              "hash: %s: not found\n",
+              cmd->words[i]);
+      status = -1;
+    }
+  }
+  return status;
+}
+
 /** built-in function selector method
  *
  * @param cmd the command under consideration
@@ -325,5 +373,6 @@ get_builtin(struct command *cmd)
   else if (strcmp(cmd->words[0], "jobs") == 0) return builtin_jobs;
   else if (strcmp(cmd->words[0], "unset") == 0) return builtin_unset;
   else if (strcmp(cmd->words[0], "export") == 0) return builtin_export;
+  else if (strcmp(cmd->words[0], "hash") == 0) return builtin_hash;
   else return 0;
 }
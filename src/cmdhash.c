@@ -0,0 +1,193 @@
+#define _POSIX_C_SOURCE 200809L
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "cmdhash.h"
+#include "util/gprintf.h"
+#include "util/strhash.h"
+#include "vars.h"
+
+struct cmd {
+  struct cmd *next;
+  char *path;
+  unsigned long hits;
+  char name[];
+};
+
+/* Chained hash table, keyed on command name. The bucket count is always a
+ * power of two, and doubles once there are more records than buckets. */
+static struct cmd **cmd_table = 0;
+static size_t cmd_table_size = 0;
+static size_t cmd_count = 0;
+
+/* execvp()'s search path when PATH is unset */
+static char const default_path[] = "/bin:/usr/bin";
+
+static struct cmd **
+find_link(char const *name)
+{
+  if (!cmd_table) return 0;
+  struct cmd **link = &cmd_table[strhash(name) & (cmd_table_size - 1)];
+  for (; *link; link = &(*link)->next) {
+    if (strcmp((*link)->name, name) == 0) return link;
+  }
+  return link;
+}
+
+static int
+grow_table(void)
+{
+  size_t new_size = cmd_table_size ? cmd_table_size * 2 : 32;
+  struct cmd **new_table = calloc(new_size, sizeof *new_table);
+  if (!new_table) return -1;
+  for (size_t i = 0; i < cmd_table_size; ++i) {
+    while (cmd_table[i]) {
+      struct cmd *c = cmd_table[i];
+      cmd_table[i] = c->next;
+      struct cmd **bucket = &new_table[strhash(c->name) & (new_size - 1)];
+      c->next = *bucket;
+      *bucket = c;
+    }
+  }
+  free(cmd_table);
+  cmd_table = new_table;
+  cmd_table_size = new_size;
+  return 0;
+}
+
+/** Searches $PATH for an executable regular file, the way execvp() does
+ *
+ * @returns allocated absolute path, or null pointer if not found
+ */
+static char *
+search_path(char const *name)
+{
+  char const *path = vars_get("PATH");
+  if (!path) path = default_path;
+  size_t const name_len = strlen(name);
+
+  for (char const *dir = path;; ++dir) {
+    char const *end = strchr(dir, ':');
+    if (!end) end = strchr(dir, '\0');
+
+    /* An empty PATH entry means the current directory */
+    size_t dir_len = end - dir;
+    char *candidate = malloc(dir_len + name_len + 3);
+    if (!candidate) return 0;
+    if (dir_len) {
+      memcpy(candidate, dir, dir_len);
+    } else {
+      candidate[dir_len++] = '.';
+    }
+    candidate[dir_len] = '/';
+    memcpy(candidate + dir_len + 1, name, name_len + 1);
+
+    struct stat st;
+    if (stat(candidate, &st) == 0 && S_ISREG(st.st_mode) &&
+        access(candidate, X_OK) == 0) {
+      gprintf("found %s at %s", name, candidate);
+      return candidate;
+    }
+    free(candidate);
+
+    dir = end;
+    if (!*dir) break;
+  }
+  errno = ENOENT;
+  return 0;
+}
+
+char const *
+cmdhash_lookup(char const *name)
+{
+  if (!name || !*name) {
+    errno = EINVAL;
+    return 0;
+  }
+  if (strchr(name, '/')) return name;
+
+  struct cmd **link = find_link(name);
+  if (link && *link) {
+    ++(*link)->hits;
+    return (*link)->path;
+  }
+
+  int const e = errno;
+  char *path = search_path(name);
+  if (!path) return 0;
+  errno = e;
+
+  if (cmd_count >= cmd_table_size) {
+    if (grow_table() < 0) goto err;
+    link = find_link(name);
+  }
+  struct cmd *c = malloc(sizeof *c + strlen(name) + 1);
+  if (!c) goto err;
+  strcpy(c->name, name);
+  c->path = path;
+  c->hits = 1;
+  c->next = 0;
+  *link = c;
+  ++cmd_count;
+  return c->path;
+
+err:
+  free(path);
+  return 0;
+}
+
+void
+cmdhash_remove(char const *name)
+{
+  if (!name) return;
+  struct cmd **link = find_link(name);
+  if (!link || !*link) return;
+  struct cmd *c = *link;
+  *link = c->next;
+  free(c->path);
+  free(c);
+  --cmd_count;
+}
+
+int
+cmdhash_foreach(int (*fn)(char const *name,
+                          char const *path,
+                          unsigned long hits,
+                          void *arg),
+                void *arg)
+{
+  for (size_t i = 0; i < cmd_table_size; ++i) {
+    for (struct cmd *c = cmd_table[i]; c; c = c->next) {
+      int res = fn(c->name, c->path, c->hits, arg);
+      if (res) return res;
+    }
+  }
+  return 0;
+}
+
+void
+cmdhash_flush(void)
+{
+  gprintf("flushing command hash table");
+  for (size_t i = 0; i < cmd_table_size; ++i) {
+    while (cmd_table[i]) {
+      struct cmd *c = cmd_table[i];
+      cmd_table[i] = c->next;
+      free(c->path);
+      free(c);
+    }
+  }
+  cmd_count = 0;
+}
+
+void
+cmdhash_cleanup(void)
+{
+  cmdhash_flush();
+  free(cmd_table);
+  cmd_table = 0;
+  cmd_table_size = 0;
+}
@@ -0,0 +1,44 @@
+#pragma once
+/** @file Hashed command locations (the `hash` builtin) */
+
+/** looks up the absolute path of a command
+ *  @returns pointer to the path, or null pointer if not found
+ *  @returns null pointer on error and sets `errno` (see exceptions)
+ *
+ *  @exception EINVAL name is a null pointer or empty
+ *  @exception ENOENT name was not found in $PATH
+ *  @exception ENOMEM not enough memory to record the location
+ *
+ *  Names containing a slash are not searched for and are returned as-is.
+ *  Otherwise $PATH is only searched the first time a name is looked up; later
+ *  lookups return the remembered location until cmdhash_flush() is called.
+ *
+ *  The returned pointer is invalidated by cmdhash_remove() and cmdhash_flush()
+ */
+char const *cmdhash_lookup(char const *name);
+
+/** forgets the remembered location of a command
+ *
+ *  Used when a remembered location turns out to be stale. Forgetting a command
+ *  that isn't remembered is not an error.
+ */
+void cmdhash_remove(char const *name);
+
+/** calls fn(name, path, hits, arg) for every remembered command
+ *  @returns 0, or the first nonzero value returned by fn
+ */
+int cmdhash_foreach(int (*fn)(char const *name,
+                              char const *path,
+                              unsigned long hits,
+                              void *arg),
+                    void *arg);
+
+/** forgets all remembered locations
+ *
+ *  Called whenever $PATH changes.
+ */
+void cmdhash_flush(void);
+
+/** frees all command records (prior to exiting)
+ */
+void cmdhash_cleanup(void);
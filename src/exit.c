@@ -3,9 +3,12 @@
 #include <signal.h>
 #include <stdlib.h>
 
+#include "cmdhash.h"
 #include "exit.h"
 #include "jobs.h"
 #include "params.h"
+#include "script.h"
+#include "scriptcache.h"
 #include "vars.h"
 
 /** cleans up and exits the shell
@@ -24,5 +27,8 @@ bigshell_exit(void)
   /* Call associated cleanup routines */
   jobs_cleanup();
   vars_cleanup();
+  cmdhash_cleanup();
+  script_cleanup();
+  scriptcache_cleanup();
   exit(params.status);
 }
@@ -17,7 +17,9 @@
 #include <unistd.h>
 
 #include "params.h"
+#include "util/arena.h"
 #include "util/asprintf.h"
+#include "util/scan.h"
 #include "vars.h"
 
 #include "expand.h"
@@ -52,50 +54,13 @@ out:
   return w;
 }
 
-char *
-expand_tilde(char **word)
-{
-  char *w = *word;
-  if (*w != '~') return w;
-
-  // start with string end. this covers "~", "~<user>"
-  char *end = strchr(w, '\0');
-
-  // if there's a slash, use that as expansion end instead
-  // this covers "~/hello/cs374" and "~<user>/hello/cs374"
-  char *slash = strchr(w, '/');
-  if (slash) {
-    end = slash;
-  }
-
-  char const *path = 0;
-  if (end == w + 1) {
-    /* Special case use HOME env variable */
-    path = vars_get("HOME");
-    if (!path) {
-      struct passwd *pw = getpwuid(getuid());
-      if (!pw) goto out; /* we tried */
-      path = pw->pw_dir;
-    }
-  } else {
-    /* General case, ~<username>/... */
-    char *nam = strndup(w + 1, end - w - 1);
-    if (!nam) err(1, 0);
-    struct passwd *pw = getpwnam(nam);
-    free(nam);
-    if (!pw) goto out; /* we tried */
-    path = pw->pw_dir;
-  }
-  w = expand_substr(word, &w, &end, path);
-out:
-  return w;
-}
-
 static char *
 find_unquoted(char const *haystack, int needle)
 {
   char const *c = haystack;
   for (; *c; (void)(*c && ++c)) {
+    /* Skip straight to the next character that could matter */
+    if (needle == '$') c = scan_expand(c);
     if (*c == needle) return (char *)c;
 
     if (*c == '\\') {
@@ -191,50 +156,318 @@ expand_parameters(char **word)
   return w;
 }
 
-static char *
-remove_quotes(char **word)
+/* Single-pass word expansion
+ *
+ * expand() performs tilde expansion, parameter expansion and quote removal in
+ * one scan over the word, appending the result to a growable output buffer.
+ * Its output is byte-for-byte what running the three as separate passes over
+ * the whole word produces, which has a few consequences worth spelling out:
+ *
+ *  - A tilde prefix is replaced first, so the home directory is itself scanned
+ *    for parameters and quotes.
+ *  - Parameter values are not rescanned for parameters, but they do go through
+ *    quote removal, like the rest of the word.
+ *  - When looking for parameters, single quotes and backslashes quote, but
+ *    double quotes don't.
+ *  - The character following a closing quote is dropped by quote removal, and
+ *    the character following $? or $! isn't checked for parameters.
+ *
+ * The output buffer is kept between calls, so once it has grown to fit the
+ * longest word, expanding doesn't allocate.
+ */
+static char *expand_buf = 0;
+static size_t expand_buf_size = 0;
+
+/* Same for the tilde-expanded copy of a word, which is scanned in its place */
+static char *tilde_buf = 0;
+static size_t tilde_buf_size = 0;
+
+struct expansion {
+  size_t len; /* bytes written to expand_buf */
+  enum {
+    QUOTE_NONE,
+    QUOTE_ESCAPE,        /* after \ */
+    QUOTE_SINGLE,        /* inside '' */
+    QUOTE_DOUBLE,        /* inside "" */
+    QUOTE_DOUBLE_ESCAPE, /* after \ inside "" */
+    QUOTE_DROP,          /* after a closing quote */
+  } quote;
+};
+
+static int
+reserve(char **buf, size_t *size, size_t need)
 {
-  char *in = *word;
-  char *out = *word;
-
-  for (; *in; (void)(*in && ++in)) {
-    if (*in == '\\') {
-      ++in;
-      if (in) {
-        *out++ = *in;
+  if (need <= *size) return 0;
+  size_t new_size = *size ? *size : 64;
+  while (new_size < need) new_size *= 2;
+  void *tmp = realloc(*buf, new_size);
+  if (!tmp) return -1;
+  *buf = tmp;
+  *size = new_size;
+  return 0;
+}
+
+/** Appends c to the output, after quote removal */
+static int
+emit(struct expansion *x, char c)
+{
+  switch (x->quote) {
+    case QUOTE_NONE:
+      if (c == '\\') x->quote = QUOTE_ESCAPE;
+      else if (c == '\'') x->quote = QUOTE_SINGLE;
+      else if (c == '"') x->quote = QUOTE_DOUBLE;
+      if (x->quote != QUOTE_NONE) return 0;
+      break;
+    case QUOTE_ESCAPE:
+      x->quote = QUOTE_NONE;
+      break;
+    case QUOTE_SINGLE:
+      if (c == '\'') {
+        x->quote = QUOTE_DROP;
+        return 0;
       }
-      continue;
+      break;
+    case QUOTE_DOUBLE:
+      if (c == '"') {
+        x->quote = QUOTE_DROP;
+        return 0;
+      }
+      if (c == '\\') {
+        x->quote = QUOTE_DOUBLE_ESCAPE;
+        return 0;
+      }
+      break;
+    case QUOTE_DOUBLE_ESCAPE:
+      x->quote = QUOTE_DOUBLE;
+      break;
+    case QUOTE_DROP:
+      x->quote = QUOTE_NONE;
+      return 0;
+  }
+  if (reserve(&expand_buf, &expand_buf_size, x->len + 2) < 0) return -1;
+  expand_buf[x->len++] = c;
+  return 0;
+}
+
+/** Appends n bytes with no quotes or backslashes among them to the output */
+static int
+emit_plain(struct expansion *x, char const *s, size_t n)
+{
+  if (!n) return 0;
+  /* Only the first byte can change the quote state */
+  if (x->quote != QUOTE_NONE && x->quote != QUOTE_SINGLE &&
+      x->quote != QUOTE_DOUBLE) {
+    if (emit(x, *s++) < 0) return -1;
+    --n;
+  }
+  if (reserve(&expand_buf, &expand_buf_size, x->len + n + 1) < 0) return -1;
+  memcpy(expand_buf + x->len, s, n);
+  x->len += n;
+  return 0;
+}
+
+static int
+emit_str(struct expansion *x, char const *s)
+{
+  for (;;) {
+    char const *end = scan_expand(s);
+    if (emit_plain(x, s, end - s) < 0) return -1;
+    if (!*end) return 0;
+    if (emit(x, *end) < 0) return -1;
+    s = end + 1;
+  }
+}
+
+/** Looks up the directory a tilde prefix refers to
+ *
+ * @param [in]name the user name following the ~, name_len bytes long
+ * @returns the directory, or null pointer if there isn't one
+ */
+static char const *
+tilde_dir(char const *name, size_t name_len)
+{
+  if (name_len == 0) {
+    /* Special case use HOME env variable */
+    char const *path = vars_get("HOME");
+    if (path) return path;
+    struct passwd *pw = getpwuid(getuid());
+    return pw ? pw->pw_dir : 0; /* we tried */
+  }
+
+  /* General case, ~<username>/... */
+  char *nam = strndup(name, name_len);
+  if (!nam) err(1, 0);
+  struct passwd *pw = getpwnam(nam);
+  free(nam);
+  return pw ? pw->pw_dir : 0; /* we tried */
+}
+
+/** Looks up a parameter by name and appends its value
+ *
+ * @param [in]name the parameter name, name_len bytes long
+ */
+static int
+emit_var(struct expansion *x, char const *name, size_t name_len)
+{
+  char buf[64];
+  char *nam = buf;
+  if (name_len < sizeof buf) {
+    memcpy(buf, name, name_len);
+    buf[name_len] = '\0';
+  } else {
+    nam = strndup(name, name_len);
+    if (!nam) err(1, 0);
+  }
+  char const *val = vars_get(nam);
+  if (nam != buf) free(nam);
+  return val ? emit_str(x, val) : 0;
+}
+
+static int
+is_name_char(char c)
+{
+  return isalpha((unsigned char)c) || isdigit((unsigned char)c) || c == '_';
+}
+
+/** Expands the parameter starting at the $ at c
+ *
+ * @returns where to continue scanning, or null pointer on failure. Sets *stop
+ * if the rest of the word must be copied without expanding any parameters.
+ */
+static char const *
+expand_param(struct expansion *x, char const *c, int *stop)
+{
+  char num[sizeof(intmax_t) * CHAR_BIT / 3 + 3];
+  char const *scan = c + 1;
+  switch (*scan) {
+    case '$':
+      snprintf(num, sizeof num, "%jd", (intmax_t)getpid());
+      return emit_str(x, num) < 0 ? 0 : scan + 1;
+    case '!':
+    case '?':
+      if (*scan == '!') {
+        snprintf(num, sizeof num, "%jd", (intmax_t)params.bg_pid);
+      } else {
+        snprintf(num, sizeof num, "%d", params.status);
+      }
+      if (emit_str(x, num) < 0) return 0;
+      ++scan;
+      /* The next character is copied without being checked for a $ */
+      if (!*scan) return scan;
+      return emit(x, *scan) < 0 ? 0 : scan + 1;
+    case '{': {
+      char const *close = strchrnul(scan + 1, '}');
+      if (!*close) {
+        /* Unterminated ${, leave the rest of the word alone */
+        *stop = 1;
+        return c;
+      }
+      return emit_var(x, scan + 1, close - scan - 1) < 0 ? 0 : close + 1;
     }
-    if (*in == '\'') {
-      ++in;
-      for (; *in && *in != '\''; ++in) {
-        *out++ = *in;
+    default: {
+      char const *name = scan;
+      for (; is_name_char(*scan); ++scan);
+      if (scan == name) return emit(x, '$') < 0 ? 0 : scan;
+      return emit_var(x, name, scan - name) < 0 ? 0 : scan;
+    }
+  }
+}
+
+/** Expands word into expand_buf
+ *
+ * @returns length of the expansion, or -1 on failure
+ */
+static ssize_t
+expand_into_buf(char const *word)
+{
+  struct expansion x = {0};
+  char const *c = word;
+
+  if (*c == '~') {
+    char const *end = strchrnul(c, '/');
+    char const *dir = tilde_dir(c + 1, end - c - 1);
+    if (dir) {
+      size_t dir_len = strlen(dir);
+      size_t rest_len = strlen(end);
+      if (reserve(&tilde_buf, &tilde_buf_size, dir_len + rest_len + 1) < 0) {
+        return -1;
       }
-      ++in;
+      memcpy(tilde_buf, dir, dir_len);
+      memcpy(tilde_buf + dir_len, end, rest_len + 1);
+      c = tilde_buf;
+    }
+  }
+
+  int stop = 0;
+  while (*c) {
+    if (stop) {
+      if (emit(&x, *c++) < 0) return -1;
       continue;
     }
-    if (*in == '"') {
-      ++in;
-      for (; *in && *in != '"'; ++in) {
-        if (*in == '\\') {
-          ++in;
+    switch (*c) {
+      case '$':
+        c = expand_param(&x, c, &stop);
+        if (!c) return -1;
+        break;
+      case '\\':
+        /* Escaped characters aren't checked for a $ */
+        if (emit(&x, *c++) < 0) return -1;
+        if (*c && emit(&x, *c++) < 0) return -1;
+        break;
+      case '\'':
+        /* Neither are single-quoted ones */
+        if (emit(&x, *c++) < 0) return -1;
+        for (;;) {
+          char const *end = scan_expand(c);
+          if (emit_plain(&x, c, end - c) < 0) return -1;
+          c = end;
+          if (!*c || *c == '\'') break;
+          if (emit(&x, *c++) < 0) return -1;
         }
-        *out++ = *in;
+        if (*c && emit(&x, *c++) < 0) return -1;
+        break;
+      default: {
+        /* Copy everything up to the next $, quote or backslash at once */
+        if (*c == '"' && emit(&x, *c++) < 0) return -1;
+        char const *end = scan_expand(c);
+        if (emit_plain(&x, c, end - c) < 0) return -1;
+        c = end;
       }
-      ++in;
-      continue;
     }
-    *out++ = *in;
   }
-  *out = 0;
-  return *word;
+  if (reserve(&expand_buf, &expand_buf_size, x.len + 1) < 0) return -1;
+  expand_buf[x.len] = '\0';
+  return x.len;
+}
+
+int
+expand_needed(char const *word)
+{
+  /* strcspn() is typically vectorized, which beats the expander's own
+   * byte-at-a-time scan by a wide margin */
+  return word[0] == '~' || word[strcspn(word, "$'\"\\")] != '\0';
 }
 
 char *
 expand(char **word)
 {
-  if (!expand_tilde(word) || !expand_parameters(word) || !remove_quotes(word))
-    return 0;
+  return expand_arena(0, word);
+}
+
+char *
+expand_arena(struct arena *a, char **word)
+{
+  ssize_t len = expand_into_buf(*word);
+  if (len < 0) return 0;
+
+  /* The expansion can be copied over the original word if it fits */
+  if ((size_t)len > strlen(*word)) {
+    char *w = a ? arena_alloc(a, len + 1) : malloc(len + 1);
+    if (!w) return 0;
+    if (!a) free(*word);
+    *word = w;
+  }
+  memcpy(*word, expand_buf, len + 1);
   return *word;
 }
 
@@ -7,6 +7,18 @@
 struct job *jobs_joblist;
 size_t jobs_joblist_size = 0;
 
+/* Maps each recorded process to its job's process group, so a child reported
+ * by waitpid(-1, ...) can be matched to its job. Open addressing with linear
+ * probing; the size is a power of two, kept at most half full, and empty
+ * slots have pid 0. */
+struct proc {
+  pid_t pid;
+  pid_t pgid;
+};
+static struct proc *proc_table = 0;
+static size_t proc_table_size = 0;
+static size_t proc_count = 0;
+
 struct job const *
 jobs_get_joblist(void)
 {
@@ -44,7 +56,7 @@ jobs_add(pid_t pgid)
 
   /* Assign members to new entry */
   jobs_joblist[insert_at] =
-      (struct job){.jid = jid, .pgid = pgid, .status = -1};
+      (struct job){.jid = jid, .pgid = pgid, .status = -1, .proc_count = 0};
   ++jobs_joblist_size;
   return jid;
 }
@@ -123,10 +135,109 @@ jobs_get_status(jid_t jid, int *status)
   return -1;
 }
 
+static struct job *
+find_job(pid_t pgid)
+{
+  for (size_t i = 0; i < jobs_joblist_size; ++i) {
+    if (jobs_joblist[i].pgid == pgid) return &jobs_joblist[i];
+  }
+  return 0;
+}
+
+/** Fibonacci hashing spreads out consecutive pids */
+static size_t
+proc_home(pid_t pid)
+{
+  return ((size_t)pid * 2654435761u) & (proc_table_size - 1);
+}
+
+/** returns the slot holding pid, or the empty slot where it would go */
+static size_t
+find_proc_slot(pid_t pid)
+{
+  size_t const mask = proc_table_size - 1;
+  size_t i = proc_home(pid);
+  for (; proc_table[i].pid && proc_table[i].pid != pid; i = (i + 1) & mask);
+  return i;
+}
+
+static int
+grow_proc_table(void)
+{
+  size_t const old_size = proc_table_size;
+  struct proc *old_table = proc_table;
+  size_t const new_size = old_size ? old_size * 2 : 64;
+  struct proc *new_table = calloc(new_size, sizeof *new_table);
+  if (!new_table) return -1;
+  proc_table = new_table;
+  proc_table_size = new_size;
+  for (size_t i = 0; i < old_size; ++i) {
+    if (!old_table[i].pid) continue;
+    proc_table[find_proc_slot(old_table[i].pid)] = old_table[i];
+  }
+  free(old_table);
+  return 0;
+}
+
+int
+jobs_add_pid(pid_t pgid, pid_t pid)
+{
+  struct job *job = find_job(pgid);
+  if (!job || pid <= 0) return -1;
+  if ((proc_count + 1) * 2 > proc_table_size && grow_proc_table() < 0) {
+    return -1;
+  }
+  size_t i = find_proc_slot(pid);
+  if (!proc_table[i].pid) ++proc_count;
+  else if (proc_table[i].pgid == pgid) return 0;
+  proc_table[i] = (struct proc){.pid = pid, .pgid = pgid};
+  ++job->proc_count;
+  return 0;
+}
+
+pid_t
+jobs_get_pid_pgid(pid_t pid)
+{
+  if (!proc_count || pid <= 0) return -1;
+  size_t i = find_proc_slot(pid);
+  return proc_table[i].pid ? proc_table[i].pgid : -1;
+}
+
+long
+jobs_remove_pid(pid_t pid)
+{
+  if (!proc_count || pid <= 0) return -1;
+  size_t const mask = proc_table_size - 1;
+  size_t i = find_proc_slot(pid);
+  if (!proc_table[i].pid) return -1;
+  struct job *job = find_job(proc_table[i].pgid);
+  proc_table[i].pid = 0;
+  --proc_count;
+
+  /* Shift back displaced records, as in vars.c's remove_var() */
+  for (size_t j = (i + 1) & mask; proc_table[j].pid; j = (j + 1) & mask) {
+    size_t const home = proc_home(proc_table[j].pid);
+    int const stays = (i < j) ? (i < home && home <= j)
+                              : (i < home || home <= j);
+    if (stays) continue;
+    proc_table[i] = proc_table[j];
+    proc_table[j].pid = 0;
+    i = j;
+  }
+
+  if (!job) return 0;
+  if (job->proc_count) --job->proc_count;
+  return job->proc_count;
+}
+
 void
 jobs_cleanup(void)
 {
   free(jobs_joblist);
   jobs_joblist = 0;
   jobs_joblist_size = 0;
+  free(proc_table);
+  proc_table = 0;
+  proc_table_size = 0;
+  proc_count = 0;
 }
@@ -9,6 +9,7 @@ struct job {
   jid_t jid;  /* Job id */
   pid_t pgid; /* Process group id */
   int status;
+  size_t proc_count; /* Processes recorded with jobs_add_pid() */
 };
 
 /** Gets a list of all jobs
@@ -76,5 +77,28 @@ extern int jobs_set_status(jid_t jobid, int status);
  */
 extern int jobs_get_status(jid_t jobid, int *status);
 
+/** Records a process as part of a job
+ *
+ * @param [in]pgid the process group id of the job
+ * @param [in]pid the process id to record
+ * @returns 0 on success, -1 on failure
+ */
+extern int jobs_add_pid(pid_t pgid, pid_t pid);
+
+/** Looks up the process group a recorded process belongs to
+ *
+ * @param [in]pid the process id to look up
+ * @returns The process group id on success, -1 on failure
+ */
+extern pid_t jobs_get_pid_pgid(pid_t pid);
+
+/** Forgets a recorded process, once it has been waited on
+ *
+ * @param [in]pid the process id to forget
+ * @returns the number of processes of its job still recorded, or -1 if pid
+ * was not recorded
+ */
+extern long jobs_remove_pid(pid_t pid);
+
 /** Cleans up any resources associated with jobs tracking */
 extern void jobs_cleanup(void);
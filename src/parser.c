@@ -10,7 +10,10 @@
 
 #include "expand.h"
 #include "parser.h"
+#include "script.h"
+#include "scriptcache.h"
 #include "util/gprintf.h"
+#include "util/scan.h"
 #include "vars.h"
 
 int is_interactive = 0;
@@ -28,38 +31,13 @@ parser_init()
   return 0;
 }
 
-static void
-command_free(struct command *cmd)
-{
-  if (cmd) {
-    for (size_t i = 0; i < cmd->assignment_count; ++i) {
-      free(cmd->assignments[i]->name);
-      free(cmd->assignments[i]->value);
-      free(cmd->assignments[i]);
-    }
-    free(cmd->assignments);
-
-    for (size_t i = 0; i < cmd->word_count; ++i) {
-      free(cmd->words[i]);
-    }
-    free(cmd->words);
-
-    for (size_t i = 0; i < cmd->io_redir_count; ++i) {
-      free(cmd->io_redirs[i]->filename);
-      free(cmd->io_redirs[i]);
-    }
-    free(cmd->io_redirs);
-  }
-}
-
 void
 command_list_free(struct command_list *cl)
 {
-  for (size_t i = 0; i < cl->command_count; ++i) {
-    command_free(cl->commands[i]);
-    free(cl->commands[i]);
-  }
-  free(cl->commands);
+  arena_release(&cl->arena);
+  cl->commands = 0;
+  cl->command_count = 0;
+  cl->command_capacity = 0;
 }
 
 char const *
@@ -164,7 +142,7 @@ match_num(char const **s, int *out)
 }
 
 static int
-match_word(char const **s, char **out)
+match_word(struct arena *a, char const **s, char **out)
 {
   int retval = 0;
   *out = 0;
@@ -178,13 +156,17 @@ match_word(char const **s, char **out)
   //          | /"([^"]|\\")*"/
   //          | /'[^']*'/
   //          ;
-  for (; !isblank(*c); ++c) {
-    if (strchr("&;|<>\n", *c) != 0) break;
+  for (;; ++c) {
+    /* Skip over the plain characters of an unquoted word part */
+    c = scan_word(c);
+    if (isblank(*c) || strchr("&;|<>\n", *c) != 0) break;
 
     if (*c == '"') {
       /* Double quotes */
       ++c;
-      for (; *c != '"'; ++c) {
+      for (;; ++c) {
+        c = scan_dquoted(c);
+        if (*c == '"') break;
         if (!*c) {
           gprintf("unmatched double quote");
           retval = -2;
@@ -203,13 +185,11 @@ match_word(char const **s, char **out)
       }
     } else if (*c == '\'') {
       /* Single quotes */
-      ++c;
-      for (; *c != '\''; ++c) {
-        if (!*c) {
-          gprintf("unmatched single quote");
-          retval = -3;
-          goto err;
-        }
+      c = scan_squoted(c + 1);
+      if (*c != '\'') {
+        gprintf("unmatched single quote");
+        retval = -3;
+        goto err;
       }
     } else if (*c == '\\') {
       /* Escape */
@@ -224,7 +204,7 @@ match_word(char const **s, char **out)
   if (c == word) goto match_fail;
 
   { /* Write output */
-    void *tmp = strndup(word, c - word);
+    void *tmp = arena_strndup(a, word, c - word);
     if (!tmp) {
       retval = -errno;
       goto err;
@@ -246,7 +226,7 @@ match_word(char const **s, char **out)
 
 /** [0-9]*(>>|>&|<&|<>|>|<)[ \t]*{word} */
 static int
-match_redirect(char const **s, struct io_redir **redir)
+match_redirect(struct arena *a, char const **s, struct io_redir **redir)
 {
   int retval = 0;
   *redir = 0;
@@ -292,13 +272,13 @@ match_redirect(char const **s, struct io_redir **redir)
   }
 
   discard_whitespace(&c);
-  retval = match_word(&c, &filename);
+  retval = match_word(a, &c, &filename);
   if (retval < 0) goto err;
   if (retval == 0) goto match_fail;
   r.filename = filename;
 
   { /* Write output */
-    void *tmp = malloc(sizeof **redir);
+    void *tmp = arena_alloc(a, sizeof **redir);
     if (!tmp) {
       retval = -1;
       goto err;
@@ -311,17 +291,16 @@ match_redirect(char const **s, struct io_redir **redir)
   if (0) {
   match_fail:
     retval = 0;
-  err:
-    free(filename);
+  err:;
   }
   return retval;
 }
 
 static int
-match_assignment(char const **s, struct assignment **assn)
+match_assignment(struct arena *a, char const **s, struct assignment **assn)
 {
   int retval = 0;
-  struct assignment a = {0};
+  struct assignment as = {0};
 
   char const *c = *s;
 
@@ -330,49 +309,79 @@ match_assignment(char const **s, struct assignment **assn)
   if (!isalpha(name[0]) && name[0] != '_') goto match_fail;
 
   for (; isalnum(*c) || *c == '_'; ++c);
-  a.name = strndup(name, c - name);
-  if (!a.name) {
-    retval = -1;
-    goto err;
-  }
 
   /* match "=" */
   if (*c != '=') goto match_fail;
+
+  as.name = arena_strndup(a, name, c - name);
+  if (!as.name) {
+    retval = -1;
+    goto err;
+  }
   ++c;
 
   /* Get value */
-  retval = match_word(&c, &a.value);
+  retval = match_word(a, &c, &as.value);
   if (retval < 0) goto err;
-  if (retval == 0) a.value = strdup("");
+  if (retval == 0) as.value = arena_strdup(a, "");
+  if (!as.value) {
+    retval = -1;
+    goto err;
+  }
 
   { /* Write output */
-    void *tmp = malloc(sizeof **assn);
+    void *tmp = arena_alloc(a, sizeof **assn);
     if (!tmp) {
       retval = -1;
       goto err;
     }
     *assn = tmp;
-    **assn = a;
+    **assn = as;
   }
   retval = c - *s;
   *s = c;
   if (0) {
   match_fail:
     retval = 0;
-  err:
-    free(a.name);
-    free(a.value);
+  err:;
   }
   return retval;
 }
 
+/** Makes room for one more element in an arena-backed array
+ *
+ * @param [in]a the arena the array belongs to
+ * @param [in]array the array, holding count elements of size bytes each
+ * @param [in,out]capacity number of elements the array has room for
+ * @returns the (possibly moved) array, or null pointer on failure
+ *
+ * Capacity doubles whenever the array is full, so appending is amortized O(1).
+ * The old array is simply abandoned to the arena.
+ */
+static void *
+reserve_one(struct arena *a,
+            void *array,
+            size_t count,
+            size_t *capacity,
+            size_t size)
+{
+  if (count < *capacity) return array;
+  size_t new_capacity = *capacity ? *capacity * 2 : 4;
+  void *tmp = arena_alloc(a, new_capacity * size);
+  if (!tmp) return 0;
+  if (count) memcpy(tmp, array, count * size);
+  *capacity = new_capacity;
+  return tmp;
+}
+
 static int
-add_assignment(struct command *cmd, struct assignment *assn)
+add_assignment(struct arena *a, struct command *cmd, struct assignment *assn)
 {
-  /* NOLINTBEGIN */
-  void *tmp = realloc(cmd->assignments,
-                      sizeof *cmd->assignments * (cmd->assignment_count + 1));
-  /* NOLINTEND */
+  void *tmp = reserve_one(a,
+                          cmd->assignments,
+                          cmd->assignment_count,
+                          &cmd->assignment_capacity,
+                          sizeof *cmd->assignments);
   if (!tmp) return -1;
   cmd->assignments = tmp;
   cmd->assignments[cmd->assignment_count++] = assn;
@@ -380,9 +389,13 @@ add_assignment(struct command *cmd, struct assignment *assn)
 }
 
 static int
-add_word(struct command *cmd, char *word)
+add_word(struct arena *a, struct command *cmd, char *word)
 {
-  void *tmp = realloc(cmd->words, sizeof *cmd->words * (cmd->word_count + 1));
+  void *tmp = reserve_one(a,
+                          cmd->words,
+                          cmd->word_count,
+                          &cmd->word_capacity,
+                          sizeof *cmd->words);
   if (!tmp) return -1;
   cmd->words = tmp;
   cmd->words[cmd->word_count++] = word;
@@ -390,12 +403,13 @@ add_word(struct command *cmd, char *word)
 }
 
 static int
-add_redirection(struct command *cmd, struct io_redir *redir)
+add_redirection(struct arena *a, struct command *cmd, struct io_redir *redir)
 {
-  /* NOLINTBEGIN */
-  void *tmp = realloc(cmd->io_redirs,
-                      sizeof *cmd->io_redirs * (cmd->io_redir_count + 1));
-  /* NOLINTEND */
+  void *tmp = reserve_one(a,
+                          cmd->io_redirs,
+                          cmd->io_redir_count,
+                          &cmd->io_redir_capacity,
+                          sizeof *cmd->io_redirs);
   if (!tmp) return -1;
   cmd->io_redirs = tmp;
   cmd->io_redirs[cmd->io_redir_count++] = redir;
@@ -403,7 +417,7 @@ add_redirection(struct command *cmd, struct io_redir *redir)
 }
 
 static int
-match_command(char const **s, struct command **command)
+match_command(struct arena *a, char const **s, struct command **command)
 {
   int retval = 0;
   struct command cmd = {0};
@@ -413,30 +427,30 @@ match_command(char const **s, struct command **command)
     discard_whitespace(&c);
     if (cmd.word_count == 0) {
       struct assignment *assn = 0;
-      retval = match_assignment(&c, &assn);
+      retval = match_assignment(a, &c, &assn);
       if (retval < 0) goto err;
       if (retval > 0) {
-        add_assignment(&cmd, assn);
+        add_assignment(a, &cmd, assn);
         continue;
       }
     }
 
     {
       struct io_redir *redir;
-      retval = match_redirect(&c, &redir);
+      retval = match_redirect(a, &c, &redir);
       if (retval < 0) goto err;
       if (retval > 0) {
-        add_redirection(&cmd, redir);
+        add_redirection(a, &cmd, redir);
         continue;
       }
     }
 
     {
       char *word;
-      retval = match_word(&c, &word);
+      retval = match_word(a, &c, &word);
       if (retval < 0) goto err;
       if (retval > 0) {
-        add_word(&cmd, word);
+        add_word(a, &cmd, word);
         continue;
       }
     }
@@ -472,11 +486,11 @@ match_command(char const **s, struct command **command)
   }
 
   if (cmd.word_count > 0) {
-    add_word(&cmd, 0);
+    add_word(a, &cmd, 0);
     --cmd.word_count;
   }
   { /* Write output */
-    void *tmp = malloc(sizeof **command);
+    void *tmp = arena_alloc(a, sizeof **command);
     if (!tmp) {
       retval = -1;
       goto err;
@@ -489,8 +503,7 @@ match_command(char const **s, struct command **command)
   if (0) {
   match_fail:
     retval = 0;
-  err:
-    command_free(&cmd);
+  err:;
   }
   return retval;
 }
@@ -498,10 +511,11 @@ match_command(char const **s, struct command **command)
 static int
 add_command(struct command_list *cl, struct command *cmd)
 {
-  /* NOLINTBEGIN */
-  void *tmp =
-      realloc(cl->commands, sizeof *cl->commands * (cl->command_count + 1));
-  /* NOLINTEND */
+  void *tmp = reserve_one(&cl->arena,
+                          cl->commands,
+                          cl->command_count,
+                          &cl->command_capacity,
+                          sizeof *cl->commands);
   if (!tmp) return -1;
   cl->commands = tmp;
   cl->commands[cl->command_count++] = cmd;
@@ -518,6 +532,11 @@ command_list_parse(struct command_list **cl, FILE *stream)
   char const *c;
   ssize_t line_length;
   struct command *cmd = 0;
+  if (!is_interactive) {
+    /* Scripts may have been compiled already */
+    int result;
+    if (scriptcache_parse(cl, stream, &result)) return result;
+  }
   void *tmp = malloc(sizeof **cl);
   if (!tmp) {
     retval = -1;
@@ -525,7 +544,9 @@ command_list_parse(struct command_list **cl, FILE *stream)
   }
   *cl = tmp;
   (*cl)->command_count = 0;
+  (*cl)->command_capacity = 0;
   (*cl)->commands = 0;
+  (*cl)->arena = (struct arena){0};
   do {
     if (is_interactive) {
       char const *s = 0;
@@ -552,7 +573,14 @@ command_list_parse(struct command_list **cl, FILE *stream)
       }
       free(s_copy);
     }
-    line_length = getline(&line, &n, stream);
+    if (is_interactive) {
+      line_length = getline(&line, &n, stream);
+      c = line;
+    } else {
+      /* Scripts are parsed straight out of the reader's buffer */
+      line_length = script_read_line(fileno(stream), &c);
+      if (line_length == 0) goto eof;
+    }
     if (line_length < 0) {
       if (feof(stream)) {
         goto eof;
@@ -560,10 +588,9 @@ command_list_parse(struct command_list **cl, FILE *stream)
       retval = -1;
       goto err;
     }
-    c = line;
     while (*c) {
       discard_whitespace(&c);
-      retval = match_command(&c, &cmd);
+      retval = match_command(&(*cl)->arena, &c, &cmd);
       gprintf("match command returned %d", retval);
       if (retval < 0) goto err;
       if (retval == 0) {
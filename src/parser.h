@@ -2,6 +2,8 @@
 #pragma once
 #include <stdio.h>
 
+#include "util/arena.h"
+
 /* This is the main command list structure returned by command_list_parse.
  *
  * You will access the members of this structure to perform tasks in the
@@ -17,12 +19,14 @@ struct command_list {
       char *value;
     } **assignments;
     size_t assignment_count;
+    size_t assignment_capacity;
 
     /* Command words
      * This is the name of the command, and its arguments (if any)
      */
     char **words;
     size_t word_count;
+    size_t word_capacity;
 
     /* I/O redirection operators 
      */
@@ -44,6 +48,7 @@ struct command_list {
       char *filename;
     } **io_redirs;
     size_t io_redir_count;
+    size_t io_redir_capacity;
 
     /* The control operator ending this particular command
      *
@@ -53,6 +58,11 @@ struct command_list {
   } **commands;
 
   size_t command_count;
+  size_t command_capacity;
+
+  /* Owns every command, word, assignment and redirection in the list, and
+   * the arrays of pointers to them. Released by command_list_free(). */
+  struct arena arena;
 };
 
 extern int is_interactive;
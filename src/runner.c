@@ -4,6 +4,7 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <limits.h>
+#include <spawn.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
@@ -11,6 +12,7 @@
 #include <wait.h>
 
 #include "builtins.h"
+#include "cmdhash.h"
 #include "exit.h"
 #include "expand.h"
 #include "jobs.h"
@@ -23,6 +25,8 @@
 
 #include "runner.h"
 
+extern char **environ;
+
 /* Expands all the command words in a command
  *
  * This is:
@@ -35,21 +39,25 @@
  *   cmd->io_redirs[i]->filename
  *      ; i from 0 to cmd->io_redir_count
  *
+ * The words belong to the command list's arena, a, and so do their expansions.
+ * Literal words, which expand to themselves, are skipped.
  * */
 static int
-expand_command_words(struct command *cmd)
+expand_command_words(struct arena *a, struct command *cmd)
 {
   for (size_t i = 0; i < cmd->word_count; ++i) {
-    expand(&cmd->words[i]);
+    if (expand_needed(cmd->words[i])) expand_arena(a, &cmd->words[i]);
   }
   /* BGDID Assignment values */
   for (size_t i = 0; i < cmd->assignment_count; ++i) {
-    expand(&cmd->assignments[i]->value);
+    char **value = &cmd->assignments[i]->value;
+    if (expand_needed(*value)) expand_arena(a, value);
   }
 
   /* BGDID I/O Filenames */
   for (size_t i = 0; i < cmd->io_redir_count; ++i) {
-    expand(&cmd->io_redirs[i]->filename);
+    char **filename = &cmd->io_redirs[i]->filename;
+    if (expand_needed(*filename)) expand_arena(a, filename);
   }
   return 0;
 }
@@ -369,6 +377,122 @@ do_io_redirects(struct command *cmd)
   return status;
 }
 
+/** reports errno and exits from a forked child
+ *
+ * Like err(), but without exit()'s stdio cleanup: when the shell is reading a
+ * script, flushing the child's copy of stdin would seek the shared file offset
+ * back and make the parent re-read commands it has already run.
+ */
+static void
+child_err(int status)
+{
+  warn(0);
+  _exit(status);
+}
+
+/** starts an external command with posix_spawn() instead of fork()
+ *
+ * @param [in]cmd the (expanded) command to start
+ * @param [in]path location of the command, from cmdhash_lookup()
+ * @param pgid the process group to join, or 0 to lead a new one
+ * @param upstream_pipefd read side of the upstream pipe, or -1
+ * @param downstream_pipefd write side of the downstream pipe, or -1
+ * @param [out]pid the spawned child
+ * @returns 0 on success, -1 if the command must be started with fork() instead
+ *
+ * The child-side steps of the fork() path in run_command_list() are translated
+ * into spawn file actions and attributes: the pipe wiring and do_io_redirects()
+ * become dup2/close/open actions, setpgid() becomes POSIX_SPAWN_SETPGROUP, and
+ * signal_restore() becomes POSIX_SPAWN_SETSIGDEF. This lets libc use a
+ * vfork-style clone that doesn't copy the shell's page tables.
+ *
+ * Anything without an equivalent falls back to fork(): variable assignments
+ * (exported with setenv() in the child), and `>` redirects, whose O_EXCL would
+ * fail spuriously if the fork() path has to retry a failed spawn. Any spawn
+ * failure also falls back, so that the forked child reports the error exactly
+ * as it always has.
+ */
+static int
+spawn_command(struct command *cmd,
+              char const *path,
+              pid_t pgid,
+              int upstream_pipefd,
+              int downstream_pipefd,
+              pid_t *pid)
+{
+  if (!path || cmd->assignment_count > 0) return -1;
+
+  posix_spawn_file_actions_t actions;
+  posix_spawnattr_t attr;
+  int e = posix_spawn_file_actions_init(&actions);
+  if (e) goto out;
+  e = posix_spawnattr_init(&attr);
+  if (e) goto out_actions;
+
+  if (upstream_pipefd >= 0 && upstream_pipefd != STDIN_FILENO) {
+    e = posix_spawn_file_actions_adddup2(&actions,
+                                         upstream_pipefd,
+                                         STDIN_FILENO);
+    if (!e) e = posix_spawn_file_actions_addclose(&actions, upstream_pipefd);
+  }
+  if (!e && downstream_pipefd >= 0 && downstream_pipefd != STDOUT_FILENO) {
+    e = posix_spawn_file_actions_adddup2(&actions,
+                                         downstream_pipefd,
+                                         STDOUT_FILENO);
+    if (!e) e = posix_spawn_file_actions_addclose(&actions, downstream_pipefd);
+  }
+
+  /* Same interpretation of the redirection list as do_io_redirects() */
+  for (size_t i = 0; !e && i < cmd->io_redir_count; ++i) {
+    struct io_redir *r = cmd->io_redirs[i];
+    if (r->io_op == OP_GREATAND || r->io_op == OP_LESSAND) {
+      if (strcmp(r->filename, "-") == 0) {
+        e = posix_spawn_file_actions_addclose(&actions, r->io_number);
+        continue;
+      }
+      char *end = r->filename;
+      long src = strtol(r->filename, &end, 10);
+      if (*(r->filename) && !*end && src <= INT_MAX) {
+        e = posix_spawn_file_actions_adddup2(&actions, src, r->io_number);
+        continue;
+      }
+    }
+    int flags = get_io_flags(r->io_op);
+    if (flags & O_EXCL) {
+      e = ENOTSUP;
+      break;
+    }
+    e = posix_spawn_file_actions_addopen(&actions,
+                                         r->io_number,
+                                         r->filename,
+                                         flags,
+                                         0777);
+  }
+
+  sigset_t sigdef;
+  if (!e && signal_restore_set(&sigdef) < 0) e = errno;
+  if (!e) e = posix_spawnattr_setsigdefault(&attr, &sigdef);
+  if (!e) e = posix_spawnattr_setpgroup(&attr, pgid);
+  if (!e) {
+    e = posix_spawnattr_setflags(&attr,
+                                 POSIX_SPAWN_SETPGROUP | POSIX_SPAWN_SETSIGDEF);
+  }
+  char **envp = 0;
+  if (!e && !(envp = vars_environ())) e = errno;
+  if (!e) e = posix_spawn(pid, path, &actions, &attr, cmd->words, envp);
+  gprintf("posix_spawn(%s) returned %d", path, e);
+
+  posix_spawnattr_destroy(&attr);
+out_actions:
+  posix_spawn_file_actions_destroy(&actions);
+out:
+  if (e) {
+    errno = e;
+    return -1;
+  }
+  return 0;
+}
+
 int
 run_command_list(struct command_list *cl)
 {
@@ -384,7 +508,7 @@ run_command_list(struct command_list *cl)
   for (size_t i = 0; i < cl->command_count; ++i) {
     struct command *cmd = cl->commands[i];
     /* First, handle expansions (tilde, parameter, quote removal) */
-    expand_command_words(cmd);
+    expand_command_words(&cl->arena, cmd);
 
     // clang-format off
     // Next, figure out what kind of command are we running?
@@ -468,6 +592,15 @@ run_command_list(struct command_list *cl)
     builtin_fn const builtin = get_builtin(cmd);
     int const is_builtin = !!builtin;
 
+    /* External commands are located through the command hash table, unless
+     * an assignment (e.g. PATH=...) changes the environment they are looked
+     * up in. A null cmd_path leaves the search to execvp() in the child. */
+    char const *cmd_path = 0;
+    if (!is_builtin && cmd->assignment_count == 0) {
+      cmd_path = cmdhash_lookup(cmd->words[0]);
+      errno = 0;
+    }
+
     pid_t child_pid = 0;
     /*
      * [TODO] Fork process if:
@@ -493,9 +626,22 @@ run_command_list(struct command_list *cl)
        * it in both the parent and the child, and ignore an EACCES error if it
        * occurs.
        */
-      // [BGDID] fork
-      child_pid = fork();
-      if (child_pid == -1) goto err;    // BG added; example on pg 517 in Linux Prgramming Interface
+      /* External commands take the posix_spawn() fast path when they can,
+       * everything else (including failed spawns) is forked */
+      if (is_builtin || spawn_command(cmd,
+                                      cmd_path,
+                                      pipeline_data.pgid,
+                                      upstream_pipefd,
+                                      downstream_pipefd,
+                                      &child_pid) < 0) {
+        /* The remembered location may be stale; let execvp() search */
+        if (cmd_path) cmdhash_remove(cmd->words[0]);
+        cmd_path = 0;
+        errno = 0;
+        // [BGDID] fork
+        child_pid = fork();
+        if (child_pid == -1) goto err;    // BG added; example on pg 517 in Linux Prgramming Interface
+      }
 
       if (setpgid(child_pid, pipeline_data.pgid) < 0) {
         if (errno == EACCES) errno = 0;
@@ -508,6 +654,10 @@ run_command_list(struct command_list *cl)
         pipeline_data.jid = jobs_add(child_pid);
         if (pipeline_data.jid < 0) goto err;
       }
+      /* So the reaper can tell which job the child belongs to */
+      if (child_pid && jobs_add_pid(pipeline_data.pgid, child_pid) < 0) {
+        goto err;
+      }
     }
 
     /* Now that that's taken care of, let's actually execute the command */
@@ -552,7 +702,7 @@ run_command_list(struct command_list *cl)
 
         params.status = result ? 127 : 0;
         /* If we forked, exit now */
-        if (!is_fg) exit(params.status);
+        if (!is_fg) _exit(params.status);
 
         /* Otherwise, we are running in the current shell and
          * need to clean up before falling through */
@@ -580,15 +730,19 @@ run_command_list(struct command_list *cl)
         }
 
         /* Now handle the remaining redirect operators from the command. */
-        if (do_io_redirects(cmd) < 0) err(1, 0);
+        if (do_io_redirects(cmd) < 0) child_err(1);
 
         /* Next, perform variable assignment, with variables exported as
          * they are assigned (export_all flag) */
-        if (do_variable_assignment(cmd, 1) < 0) err(1, 0);
+        if (do_variable_assignment(cmd, 1) < 0) child_err(1);
 
         /* Restore signals to their original values when bigshell was invoked
          */
-        if (signal_restore() < 0) err(1, 0);
+        if (signal_restore() < 0) child_err(1);
+
+        /* The shell keeps its environment in the var table; hand the child
+         * that instead of the environment bigshell was started with */
+        if (!(environ = vars_environ())) child_err(1);
 
         /* Execute the command */
         /* [TODO] execute the command described by the list of words
@@ -602,9 +756,10 @@ run_command_list(struct command_list *cl)
          *  XXX Note: cmd->words is a null-terminated array of strings. Nice!
          */
         // [BGDID] Execute the command described by the list of words
+        if (cmd_path) execv(cmd_path, cmd->words);
         execvp(cmd->words[0], cmd->words);   //words[0] holds name of command, words is an array of strings as mentioned with arguments (if any)
         // BG- No conditional because if we reach this, we "return-ed" which is a mark of an error; error sent to errno
-        err(127, 0); /* Exec failure -- why might this happen? */
+        child_err(127); /* Exec failure -- why might this happen? */
         assert(0);   /* UNREACHABLE -- This should never be reached ABORT! */
       }
     }
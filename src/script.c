@@ -0,0 +1,133 @@
+#define _POSIX_C_SOURCE 200809L
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "script.h"
+#include "util/gprintf.h"
+
+#define SCRIPT_BLOCK_SIZE (64 * 1024)
+
+/* Input is buffered in buf[0..end), of which buf[start..end) hasn't been
+ * returned yet. buf always has room for one more byte than buf_size, so a
+ * line at the very end can be null-terminated in place. */
+static char *buf = 0;
+static size_t buf_size = 0;
+static size_t start = 0;
+static size_t end = 0;
+
+/* The null byte written after the last line returned replaced this byte */
+static char saved_byte = '\0';
+static int at_eof = 0;
+
+/* Regular files are read with pread(), from file_pos, leaving the file offset
+ * for script_read_line() to keep in step with the lines returned */
+static int seekable = -1;
+static off_t file_pos = 0;
+
+/** reads another block of input into buf
+ *  @returns number of bytes read, 0 at end of input, or -1 on error
+ */
+static ssize_t
+fill(int fd)
+{
+  if (start > 0) {
+    memmove(buf, buf + start, end - start);
+    end -= start;
+    start = 0;
+  }
+  if (buf_size - end < SCRIPT_BLOCK_SIZE / 2) {
+    size_t new_size = buf_size ? buf_size * 2 : SCRIPT_BLOCK_SIZE;
+    char *tmp = realloc(buf, new_size + 1);
+    if (!tmp) return -1;
+    buf = tmp;
+    buf_size = new_size;
+  }
+
+  ssize_t n;
+  if (seekable) {
+    n = pread(fd, buf + end, buf_size - end, file_pos);
+    if (n > 0) file_pos += n;
+  } else {
+    n = read(fd, buf + end, buf_size - end);
+  }
+  if (n > 0) end += n;
+  gprintf("read %zd bytes of script", n);
+  return n;
+}
+
+ssize_t
+script_read_line(int fd, char const **line)
+{
+  if (seekable < 0) {
+    struct stat st;
+    seekable = fstat(fd, &st) == 0 && S_ISREG(st.st_mode);
+    if (seekable) file_pos = lseek(fd, 0, SEEK_CUR);
+    if (file_pos < 0) seekable = 0;
+  }
+
+  /* Put back the byte the previous line's terminator replaced */
+  if (start < end) buf[start] = saved_byte;
+
+  if (seekable) {
+    /* A command that read from the script moved the file offset; continue
+     * from wherever it stopped, like sh(1) does */
+    off_t const pos = lseek(fd, 0, SEEK_CUR);
+    if (pos < 0) return -1;
+    if (pos != file_pos - (off_t)(end - start)) {
+      gprintf("script offset moved to %jd", (intmax_t)pos);
+      start = end = 0;
+      at_eof = 0;
+      file_pos = pos;
+    }
+  }
+
+  char *nl = 0;
+  for (size_t scanned = 0;;) {
+    if (start + scanned < end) {
+      nl = memchr(buf + start + scanned, '\n', end - start - scanned);
+      if (nl) break;
+      scanned = end - start;
+    }
+    if (at_eof) break;
+    ssize_t n = fill(fd);
+    if (n < 0) return -1;
+    if (n == 0) at_eof = 1;
+  }
+  if (start == end) return 0;
+
+  size_t const line_start = start;
+  start = nl ? (size_t)(nl - buf) + 1 : end;
+  saved_byte = buf[start];
+  buf[start] = '\0';
+  *line = buf + line_start;
+
+  if (seekable) {
+    /* Leave the file offset after this line, not after the buffered input */
+    if (lseek(fd, file_pos - (off_t)(end - start), SEEK_SET) < 0) return -1;
+  }
+  return start - line_start;
+}
+
+int
+script_eof(void)
+{
+  return at_eof && start == end;
+}
+
+void
+script_cleanup(void)
+{
+  free(buf);
+  buf = 0;
+  buf_size = 0;
+  start = 0;
+  end = 0;
+  saved_byte = '\0';
+  at_eof = 0;
+  seekable = -1;
+  file_pos = 0;
+}
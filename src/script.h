@@ -0,0 +1,31 @@
+#pragma once
+/** @file Block-buffered reading of non-interactive input (scripts) */
+#include <sys/types.h>
+
+/** reads the next line of a script from fd
+ *  @returns length of the line, including its newline if it has one
+ *  @returns 0 at end of input
+ *  @returns -1 on error and sets `errno` (see exceptions)
+ *
+ *  @exception EINTR interrupted before any input was read
+ *  @exception ENOMEM not enough memory to buffer a long line
+ *  @exception Any exception produced by read(2)
+ *
+ *  *line is pointed at the line inside the reader's buffer, null-terminated,
+ *  and stays valid until the next call. Input is read 64 KiB at a time (or
+ *  more, for longer lines) instead of line by line.
+ *
+ *  If fd is a regular file, its offset is kept just past the last line
+ *  returned, so commands reading the same file pick up where the shell left
+ *  off.
+ */
+ssize_t script_read_line(int fd, char const **line);
+
+/** checks if script_read_line() has reached the end of its input
+ *  @returns 1 if yes, 0 if not
+ */
+int script_eof(void);
+
+/** frees the script buffer (prior to exiting)
+ */
+void script_cleanup(void);
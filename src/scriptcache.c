@@ -0,0 +1,567 @@
+#define _POSIX_C_SOURCE 200809L
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "script.h"
+#include "scriptcache.h"
+#include "util/arena.h"
+#include "util/asprintf.h"
+#include "util/gprintf.h"
+#include "util/strhash.h"
+#include "vars.h"
+
+/* Cache file layout. Every part but the strings is a multiple of 8 bytes
+ * long, and refers to the others by offset only, so a file can be mapped
+ * anywhere and used in place:
+ *
+ *   struct cache_header
+ *   struct cache_record[record_count], in script order
+ *   commands section, commands_size bytes
+ *   strings section, strings_size bytes
+ */
+static char const cache_magic[8] = "bshc0001";
+
+struct cache_header {
+  char magic[8];
+  uint64_t dev, ino, size;
+  int64_t mtime_sec, mtime_nsec;
+  uint64_t hash;
+  uint64_t record_count, commands_size, strings_size;
+};
+
+/* One command_list_parse() result */
+struct cache_record {
+  uint64_t start, end; /* script offsets before and after parsing */
+  int64_t result;      /* command_list_parse()'s return value */
+  uint64_t commands;   /* offset into the commands section, if result > 0 */
+  uint64_t command_count;
+};
+
+/* A null-terminated string in the strings section */
+struct cache_string {
+  uint32_t offset, length;
+};
+
+/* In the commands section, each command is followed by its assignments as
+ * name, value pairs of struct cache_string, then its words, then its
+ * redirections as struct cache_redir */
+struct cache_command {
+  uint32_t assignment_count, word_count, io_redir_count;
+  int32_t ctrl_op;
+};
+
+struct cache_redir {
+  int32_t io_number, io_op;
+  struct cache_string filename;
+};
+
+static enum {
+  CACHE_UNKNOWN,
+  CACHE_OFF,
+  CACHE_COMPILING,
+  CACHE_ON,
+} state = CACHE_UNKNOWN;
+
+/* The cache in use, either mapped from its file or freshly compiled */
+static void *image = 0;
+static size_t image_size = 0;
+static int image_mapped = 0;
+
+static struct cache_record const *records = 0;
+static size_t record_count = 0;
+static unsigned char const *commands = 0;
+static size_t commands_size = 0;
+static char const *strings = 0;
+static size_t strings_size = 0;
+
+/* The record expected next, if the script is run straight through */
+static size_t next_record = 0;
+
+/** Growable output buffer used while compiling */
+struct buf {
+  unsigned char *data;
+  size_t len, size;
+};
+
+/** Appends n bytes to b, padded to a multiple of align (a power of two)
+ *  @returns 0 on success, -1 on error
+ */
+static int
+buf_put(struct buf *b, void const *p, size_t n, size_t align)
+{
+  size_t const padded = (n + align - 1) & ~(align - 1);
+  /* Offsets into the commands and strings sections are 32 bits */
+  if (padded > UINT32_MAX - b->len) return -1;
+  if (b->size - b->len < padded) {
+    size_t new_size = b->size ? b->size : 4096;
+    while (new_size - b->len < padded) new_size *= 2;
+    void *tmp = realloc(b->data, new_size);
+    if (!tmp) return -1;
+    b->data = tmp;
+    b->size = new_size;
+  }
+  memcpy(b->data + b->len, p, n);
+  memset(b->data + b->len + n, 0, padded - n);
+  b->len += padded;
+  return 0;
+}
+
+static int
+put_string(struct buf *cmds, struct buf *strs, char const *s)
+{
+  struct cache_string cs = {strs->len, strlen(s)};
+  if (buf_put(strs, s, cs.length + 1, 1) < 0) return -1;
+  return buf_put(cmds, &cs, sizeof cs, 8);
+}
+
+static int
+put_command(struct buf *cmds, struct buf *strs, struct command const *cmd)
+{
+  struct cache_command cc = {cmd->assignment_count,
+                             cmd->word_count,
+                             cmd->io_redir_count,
+                             cmd->ctrl_op};
+  if (buf_put(cmds, &cc, sizeof cc, 8) < 0) return -1;
+  for (size_t i = 0; i < cmd->assignment_count; ++i) {
+    if (put_string(cmds, strs, cmd->assignments[i]->name) < 0) return -1;
+    if (put_string(cmds, strs, cmd->assignments[i]->value) < 0) return -1;
+  }
+  for (size_t i = 0; i < cmd->word_count; ++i) {
+    if (put_string(cmds, strs, cmd->words[i]) < 0) return -1;
+  }
+  for (size_t i = 0; i < cmd->io_redir_count; ++i) {
+    struct io_redir const *r = cmd->io_redirs[i];
+    struct cache_redir cr = {r->io_number,
+                             r->io_op,
+                             {strs->len, strlen(r->filename)}};
+    if (buf_put(strs, r->filename, cr.filename.length + 1, 1) < 0) return -1;
+    if (buf_put(cmds, &cr, sizeof cr, 8) < 0) return -1;
+  }
+  return 0;
+}
+
+/** Points the section pointers into image, after checking its layout
+ *  @returns 0 on success, -1 if image isn't a cache of this script
+ */
+static int
+use_image(struct stat const *st, uint64_t hash)
+{
+  struct cache_header const *h = image;
+  if (image_size < sizeof *h) return -1;
+  if (memcmp(h->magic, cache_magic, sizeof h->magic) != 0) return -1;
+  if (h->dev != (uint64_t)st->st_dev || h->ino != (uint64_t)st->st_ino ||
+      h->size != (uint64_t)st->st_size ||
+      h->mtime_sec != (int64_t)st->st_mtim.tv_sec ||
+      h->mtime_nsec != (int64_t)st->st_mtim.tv_nsec || h->hash != hash) {
+    return -1;
+  }
+  size_t rest = image_size - sizeof *h;
+  if (h->record_count > rest / sizeof *records) return -1;
+  rest -= h->record_count * sizeof *records;
+  if (h->commands_size > rest || h->strings_size != rest - h->commands_size) {
+    return -1;
+  }
+  records = (struct cache_record const *)(h + 1);
+  record_count = h->record_count;
+  commands = (unsigned char const *)(records + record_count);
+  commands_size = h->commands_size;
+  strings = (char const *)(commands + commands_size);
+  strings_size = h->strings_size;
+  next_record = 0;
+  return 0;
+}
+
+/** Hashes the contents of the script
+ *  @returns 0 on success, -1 on error
+ */
+static int
+hash_script(int fd, off_t size, uint64_t *hash)
+{
+  size_t const block = 64 * 1024;
+  unsigned char *b = malloc(block);
+  if (!b) return -1;
+  uint64_t h = MEMHASH_INIT;
+  off_t pos = 0;
+  while (pos < size) {
+    ssize_t n = pread(fd, b, block, pos);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) break;
+    h = memhash(b, n, h);
+    pos += n;
+  }
+  free(b);
+  if (pos != size) return -1;
+  *hash = h;
+  return 0;
+}
+
+/** Maps the cache file at path, if it's a cache of this script
+ *  @returns 0 on success, -1 if there's no usable cache
+ */
+static int
+map_cache(char const *path, struct stat const *st, uint64_t hash)
+{
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) return -1;
+  struct stat cst;
+  void *p = MAP_FAILED;
+  if (fstat(fd, &cst) == 0 && cst.st_size > 0) {
+    p = mmap(0, cst.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  }
+  close(fd);
+  if (p == MAP_FAILED) return -1;
+  image = p;
+  image_size = cst.st_size;
+  image_mapped = 1;
+  if (use_image(st, hash) < 0) {
+    gprintf("%s is stale", path);
+    munmap(image, image_size);
+    image = 0;
+    image_mapped = 0;
+    return -1;
+  }
+  gprintf("mapped %zu cached command lists from %s", record_count, path);
+  return 0;
+}
+
+/** Writes the compiled image to path, replacing any previous cache file */
+static void
+write_cache(char const *path)
+{
+  char *tmp_path = 0;
+  if (asprintf(&tmp_path, "%s.%jd", path, (intmax_t)getpid()) < 0) return;
+  int fd = open(tmp_path, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+  if (fd < 0) goto out;
+  unsigned char const *p = image;
+  size_t left = image_size;
+  while (left > 0) {
+    ssize_t n = write(fd, p, left);
+    if (n < 0 && errno == EINTR) continue;
+    if (n < 0) break;
+    p += n;
+    left -= n;
+  }
+  if (close(fd) < 0 || left > 0 || rename(tmp_path, path) < 0) {
+    gprintf("could not write %s", path);
+    unlink(tmp_path);
+  }
+out:
+  free(tmp_path);
+}
+
+/** Parses the whole script and builds the cache image from it
+ *  @returns 0 on success, -1 on error
+ *
+ *  Leaves the file offset where it was.
+ */
+static int
+compile(FILE *stream, struct stat const *st, uint64_t hash)
+{
+  int retval = -1;
+  int const fd = fileno(stream);
+  off_t const origin = lseek(fd, 0, SEEK_CUR);
+  if (origin < 0) return -1;
+  struct buf recs = {0}, cmds = {0}, strs = {0};
+
+  state = CACHE_COMPILING;
+  for (;;) {
+    struct cache_record rec = {0};
+    struct command_list *cl = 0;
+    rec.start = lseek(fd, 0, SEEK_CUR);
+    int r = command_list_parse(&cl, stream);
+    if (r == -1) goto out;
+    if (r == 0 && script_eof()) break;
+    if (r > 0 && !cl) r = 0;
+    rec.end = lseek(fd, 0, SEEK_CUR);
+    rec.result = r;
+    if (r > 0) {
+      rec.commands = cmds.len;
+      rec.command_count = cl->command_count;
+      for (size_t i = 0; i < cl->command_count; ++i) {
+        if (put_command(&cmds, &strs, cl->commands[i]) < 0) r = -1;
+      }
+      command_list_free(cl);
+      free(cl);
+      if (r < 0) goto out;
+    }
+    if (buf_put(&recs, &rec, sizeof rec, 8) < 0) goto out;
+  }
+
+  struct cache_header h = {{0},
+                           st->st_dev,
+                           st->st_ino,
+                           st->st_size,
+                           st->st_mtim.tv_sec,
+                           st->st_mtim.tv_nsec,
+                           hash,
+                           recs.len / sizeof(struct cache_record),
+                           cmds.len,
+                           strs.len};
+  memcpy(h.magic, cache_magic, sizeof h.magic);
+  image_size = sizeof h + recs.len + cmds.len + strs.len;
+  image = malloc(image_size);
+  if (!image) goto out;
+  unsigned char *p = image;
+  memcpy(p, &h, sizeof h);
+  p += sizeof h;
+  if (recs.len) memcpy(p, recs.data, recs.len);
+  p += recs.len;
+  if (cmds.len) memcpy(p, cmds.data, cmds.len);
+  p += cmds.len;
+  if (strs.len) memcpy(p, strs.data, strs.len);
+  image_mapped = 0;
+  retval = use_image(st, hash);
+  gprintf("compiled %zu command lists", record_count);
+
+out:
+  free(recs.data);
+  free(cmds.data);
+  free(strs.data);
+  /* Start reading the script over, for when the cache can't be used */
+  script_cleanup();
+  if (lseek(fd, origin, SEEK_SET) < 0) retval = -1;
+  return retval;
+}
+
+/** Decides whether to use a cache for this script, and loads or compiles it
+ */
+static void
+open_cache(FILE *stream)
+{
+  state = CACHE_OFF;
+  char const *dir = vars_get("BIGSHELL_CACHE");
+  if (!dir || !*dir) return;
+
+  int const fd = fileno(stream);
+  struct stat st;
+  if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode)) return;
+  uint64_t hash;
+  if (hash_script(fd, st.st_size, &hash) < 0) return;
+
+  char *path = 0;
+  if (asprintf(&path,
+               "%s/%jx-%jx.bshc",
+               dir,
+               (uintmax_t)st.st_dev,
+               (uintmax_t)st.st_ino) < 0) {
+    return;
+  }
+  if (map_cache(path, &st, hash) == 0) {
+    state = CACHE_ON;
+  } else if (compile(stream, &st, hash) == 0) {
+    write_cache(path);
+    state = CACHE_ON;
+  } else {
+    state = CACHE_OFF;
+    scriptcache_cleanup();
+  }
+  free(path);
+}
+
+/** Returns a pointer to size bytes at *offset in the commands section, and
+ *  advances *offset past them, or returns null pointer if out of bounds */
+static void const *
+take(uint64_t *offset, uint64_t size)
+{
+  if (size > commands_size || *offset > commands_size - size) return 0;
+  void const *p = commands + *offset;
+  *offset += size;
+  return p;
+}
+
+static char *
+load_string(struct arena *a, struct cache_string const *s)
+{
+  if ((size_t)s->length >= strings_size ||
+      s->offset > strings_size - s->length - 1 ||
+      strings[s->offset + s->length] != '\0') {
+    errno = EINVAL;
+    return 0;
+  }
+  return arena_strndup(a, strings + s->offset, s->length);
+}
+
+/** Allocates an array of count pointers, plus room for a null terminator
+ *
+ *  count is first checked against what could possibly fit in the commands
+ *  section, so a corrupt count can't cause a huge allocation.
+ */
+static void *
+alloc_array(struct arena *a, uint64_t count, size_t elem_size)
+{
+  if (count > commands_size / elem_size) {
+    errno = EINVAL;
+    return 0;
+  }
+  return arena_alloc(a, sizeof(void *) * (count + 1));
+}
+
+static struct command *
+load_command(struct arena *a, uint64_t *offset)
+{
+  struct cache_command const *cc = take(offset, sizeof *cc);
+  if (!cc) goto corrupt;
+  struct command *cmd = arena_alloc(a, sizeof *cmd);
+  if (!cmd) return 0;
+  *cmd = (struct command){0};
+  cmd->ctrl_op = cc->ctrl_op;
+
+  cmd->assignments =
+      alloc_array(a, cc->assignment_count, 2 * sizeof(struct cache_string));
+  if (!cmd->assignments) return 0;
+  for (uint64_t i = 0; i < cc->assignment_count; ++i) {
+    struct cache_string const *cs = take(offset, 2 * sizeof *cs);
+    if (!cs) goto corrupt;
+    struct assignment *as = arena_alloc(a, sizeof *as);
+    if (!as) return 0;
+    as->name = load_string(a, &cs[0]);
+    as->value = load_string(a, &cs[1]);
+    if (!as->name || !as->value) return 0;
+    cmd->assignments[i] = as;
+  }
+  cmd->assignment_count = cmd->assignment_capacity = cc->assignment_count;
+
+  cmd->words = alloc_array(a, cc->word_count, sizeof(struct cache_string));
+  if (!cmd->words) return 0;
+  for (uint64_t i = 0; i < cc->word_count; ++i) {
+    struct cache_string const *cs = take(offset, sizeof *cs);
+    if (!cs) goto corrupt;
+    cmd->words[i] = load_string(a, cs);
+    if (!cmd->words[i]) return 0;
+  }
+  cmd->words[cc->word_count] = 0;
+  cmd->word_count = cc->word_count;
+  cmd->word_capacity = cc->word_count + 1;
+
+  cmd->io_redirs =
+      alloc_array(a, cc->io_redir_count, sizeof(struct cache_redir));
+  if (!cmd->io_redirs) return 0;
+  for (uint64_t i = 0; i < cc->io_redir_count; ++i) {
+    struct cache_redir const *cr = take(offset, sizeof *cr);
+    if (!cr) goto corrupt;
+    struct io_redir *r = arena_alloc(a, sizeof *r);
+    if (!r) return 0;
+    r->io_number = cr->io_number;
+    r->io_op = cr->io_op;
+    r->filename = load_string(a, &cr->filename);
+    if (!r->filename) return 0;
+    cmd->io_redirs[i] = r;
+  }
+  cmd->io_redir_count = cmd->io_redir_capacity = cc->io_redir_count;
+  return cmd;
+
+corrupt:
+  errno = EINVAL;
+  return 0;
+}
+
+/** Builds the command list a record was compiled from
+ *  @returns 0 on success, -1 on error
+ */
+static int
+load_command_list(struct command_list **cl, struct cache_record const *rec)
+{
+  struct command_list *l = malloc(sizeof *l);
+  if (!l) return -1;
+  *l = (struct command_list){0};
+  uint64_t offset = rec->commands;
+  l->commands =
+      alloc_array(&l->arena, rec->command_count, sizeof(struct cache_command));
+  if (!l->commands) goto err;
+  for (uint64_t i = 0; i < rec->command_count; ++i) {
+    l->commands[i] = load_command(&l->arena, &offset);
+    if (!l->commands[i]) goto err;
+  }
+  l->command_count = l->command_capacity = rec->command_count;
+  *cl = l;
+  return 0;
+err:
+  command_list_free(l);
+  free(l);
+  return -1;
+}
+
+/** Finds the record compiled from the script at offset pos */
+static struct cache_record const *
+find_record(off_t pos)
+{
+  if (next_record < record_count &&
+      records[next_record].start == (uint64_t)pos) {
+    return &records[next_record];
+  }
+  /* Something moved the offset; records are in script order */
+  size_t lo = 0, hi = record_count;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (records[mid].start < (uint64_t)pos) lo = mid + 1;
+    else hi = mid;
+  }
+  if (lo < record_count && records[lo].start == (uint64_t)pos) {
+    return &records[lo];
+  }
+  return 0;
+}
+
+int
+scriptcache_parse(struct command_list **cl, FILE *stream, int *result)
+{
+  if (state == CACHE_UNKNOWN) open_cache(stream);
+  if (state != CACHE_ON) return 0;
+
+  int const fd = fileno(stream);
+  off_t const pos = lseek(fd, 0, SEEK_CUR);
+  struct cache_record const *rec = pos < 0 ? 0 : find_record(pos);
+  /* At the end of the script, or somewhere in the middle of a line */
+  if (!rec) goto off;
+  /* Only the return values command_list_strerror() knows about */
+  if (rec->result < -5 || rec->result > INT_MAX) goto off;
+
+  *cl = 0;
+  if (rec->result > 0 && load_command_list(cl, rec) < 0) {
+    if (errno == ENOMEM) {
+      *result = -1;
+      return 1;
+    }
+    goto off;
+  }
+  if (lseek(fd, rec->end, SEEK_SET) < 0) {
+    if (*cl) {
+      command_list_free(*cl);
+      free(*cl);
+      *cl = 0;
+    }
+    goto off;
+  }
+  next_record = rec - records + 1;
+  *result = rec->result;
+  return 1;
+
+off:
+  gprintf("no cached command list at offset %jd", (intmax_t)pos);
+  state = CACHE_OFF;
+  return 0;
+}
+
+void
+scriptcache_cleanup(void)
+{
+  if (image_mapped) munmap(image, image_size);
+  else free(image);
+  image = 0;
+  image_size = 0;
+  image_mapped = 0;
+  records = 0;
+  record_count = 0;
+  commands = 0;
+  commands_size = 0;
+  strings = 0;
+  strings_size = 0;
+  next_record = 0;
+}
@@ -0,0 +1,28 @@
+#pragma once
+/** @file Compiled script cache
+ *
+ *  When $BIGSHELL_CACHE names a directory and the shell's input is a regular
+ *  file, the whole script is parsed once and the result is saved there in a
+ *  compact, relocatable form. Later runs of the same, unchanged script map
+ *  the saved form and build each command list from it, instead of parsing.
+ *
+ *  Cache files are keyed on the script's device and inode number, and are
+ *  only used if its size, modification time and contents hash still match.
+ */
+#include <stdio.h>
+
+#include "parser.h"
+
+/** takes the next command list of the script from the cache
+ *  @returns 1 if the cache supplied it, and sets *result to what
+ *  command_list_parse() would have returned
+ *  @returns 0 if it must be parsed as usual
+ *
+ *  The file offset of stream is moved past the lines the command list was
+ *  compiled from, just as if they had been parsed.
+ */
+int scriptcache_parse(struct command_list **cl, FILE *stream, int *result);
+
+/** unmaps or frees the cached script (prior to exiting)
+ */
+void scriptcache_cleanup(void);
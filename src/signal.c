@@ -13,10 +13,24 @@ interrupting_signal_handler(int signo)
    */
 }
 
+/* Set whenever a child changes state, so the shell only has to look for
+ * finished jobs after one has */
+static volatile sig_atomic_t sigchld_pending = 0;
+
+static void
+sigchld_handler(int signo)
+{
+  sigchld_pending = 1;
+}
+
 static struct sigaction ignore_action = {.sa_handler = SIG_IGN},
                         interrupt_action = {.sa_handler =
                                                 interrupting_signal_handler},
-                        old_sigtstp, old_sigint, old_sigttou;
+                        sigchld_action = {.sa_handler = sigchld_handler,
+                                          .sa_flags = SA_RESTART},
+                        sigchld_interrupt_action = {.sa_handler =
+                                                        sigchld_handler},
+                        old_sigtstp, old_sigint, old_sigttou, old_sigchld;
 
 /* Ignore certain signals.
  * 
@@ -47,6 +61,8 @@ signal_init(void)
 
   if (sigaction(SIGTTOU, &ignore_action, &old_sigttou) < 0) return -1;
 
+  if (sigaction(SIGCHLD, &sigchld_action, &old_sigchld) < 0) return -1;
+
   return 0;
 
 }
@@ -106,5 +122,70 @@ signal_restore(void)
 
   if (sigaction(SIGTTOU, &old_sigttou, NULL) < 0) return -1;
 
+  if (sigaction(SIGCHLD, &old_sigchld, NULL) < 0) return -1;
+
+  return 0;
+}
+
+/** makes SIGCHLD interrupt blocking syscalls, or restart them again
+ *
+ * @param enable nonzero to interrupt, zero to restart
+ * @returns 0 on success, -1 on failure
+ *
+ * Either way, the arrival of SIGCHLD is recorded for signal_sigchld_pending().
+ */
+int
+signal_sigchld_interrupt(int enable)
+{
+  struct sigaction const *act =
+      enable ? &sigchld_interrupt_action : &sigchld_action;
+  if (sigaction(SIGCHLD, act, NULL) < 0) return -1;
+  return 0;
+}
+
+/** checks if SIGCHLD has arrived since the last signal_sigchld_clear()
+ *
+ * @returns 1 if yes, 0 if not
+ */
+int
+signal_sigchld_pending(void)
+{
+  return sigchld_pending;
+}
+
+/** forgets any SIGCHLD that has arrived so far
+ */
+void
+signal_sigchld_clear(void)
+{
+  sigchld_pending = 0;
+}
+
+/** Collects the signals that signal_restore() returns to their default action
+ *
+ * @param [out]set filled with every saved signal whose old disposition was
+ *                 not SIG_IGN
+ * @returns 0 on success, -1 on failure
+ *
+ * Ignored dispositions are inherited across exec, and caught ones are reset to
+ * the default, so this set is all a spawned child needs (POSIX_SPAWN_SETSIGDEF)
+ * to end up in the same state signal_restore() would leave a forked child in.
+ */
+int
+signal_restore_set(sigset_t *set)
+{
+  struct {
+    int signo;
+    struct sigaction const *old;
+  } const saved[] = {{SIGTSTP, &old_sigtstp},
+                     {SIGINT, &old_sigint},
+                     {SIGTTOU, &old_sigttou},
+                     {SIGCHLD, &old_sigchld}};
+
+  if (sigemptyset(set) < 0) return -1;
+  for (size_t i = 0; i < sizeof saved / sizeof *saved; ++i) {
+    if (saved[i].old->sa_handler == SIG_IGN) continue;
+    if (sigaddset(set, saved[i].signo) < 0) return -1;
+  }
   return 0;
 }
@@ -1,5 +1,10 @@
 #pragma once
+#include <signal.h>
 extern int signal_init(void);
 extern int signal_enable_interrupt(int sig);
 extern int signal_ignore(int sig);
 extern int signal_restore(void);
+extern int signal_restore_set(sigset_t *set);
+extern int signal_sigchld_interrupt(int enable);
+extern int signal_sigchld_pending(void);
+extern void signal_sigchld_clear(void);
@@ -0,0 +1,95 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+
+/* Allocations are rounded up to the size of this union, which keeps them
+ * suitably aligned for any object the parser stores */
+union arena_align {
+  long double ld;
+  long long ll;
+  void *p;
+  void (*fp)(void);
+};
+
+struct arena_block {
+  struct arena_block *next;
+  size_t size; /* usable bytes in data[] */
+  size_t used;
+  union arena_align data[];
+};
+
+/* Most command lines fit in a single block of this size */
+#define ARENA_BLOCK_SIZE 4096
+
+/* One released block of the default size is kept around for the next arena,
+ * so parsing a typical line doesn't touch malloc() at all. */
+static struct arena_block *spare_block = 0;
+
+static struct arena_block *
+new_block(size_t min_size)
+{
+  struct arena_block *b;
+  if (min_size <= ARENA_BLOCK_SIZE && spare_block) {
+    b = spare_block;
+    spare_block = 0;
+  } else {
+    size_t size = min_size > ARENA_BLOCK_SIZE ? min_size : ARENA_BLOCK_SIZE;
+    b = malloc(sizeof *b + size);
+    if (!b) return 0;
+    b->size = size;
+  }
+  b->used = 0;
+  return b;
+}
+
+void *
+arena_alloc(struct arena *a, size_t size)
+{
+  size_t const align = sizeof(union arena_align);
+  size = (size + align - 1) / align * align;
+  if (size == 0) size = align;
+
+  struct arena_block *b = a->head;
+  if (!b || b->size - b->used < size) {
+    b = new_block(size);
+    if (!b) return 0;
+    b->next = a->head;
+    a->head = b;
+  }
+  void *p = (char *)b->data + b->used;
+  b->used += size;
+  return p;
+}
+
+char *
+arena_strndup(struct arena *a, char const *s, size_t n)
+{
+  n = strnlen(s, n);
+  char *p = arena_alloc(a, n + 1);
+  if (!p) return 0;
+  memcpy(p, s, n);
+  p[n] = '\0';
+  return p;
+}
+
+char *
+arena_strdup(struct arena *a, char const *s)
+{
+  return arena_strndup(a, s, strlen(s));
+}
+
+void
+arena_release(struct arena *a)
+{
+  while (a->head) {
+    struct arena_block *b = a->head;
+    a->head = b->next;
+    if (b->size == ARENA_BLOCK_SIZE && !spare_block) {
+      spare_block = b;
+    } else {
+      free(b);
+    }
+  }
+}
@@ -0,0 +1,35 @@
+#pragma once
+#include <stddef.h>
+
+/** Bump allocator
+ *
+ *  Hands out memory from a chain of large blocks. Individual allocations are
+ *  never freed; everything is released at once with arena_release().
+ *
+ *  A zero-initialized struct arena is an empty arena, ready for use.
+ */
+struct arena {
+  struct arena_block *head;
+};
+
+/** Allocates size bytes, aligned for any object type
+ *
+ *  @returns pointer to the allocation, or null pointer on error and sets
+ *  `errno` (see exceptions)
+ *
+ *  @exception ENOMEM
+ */
+void *arena_alloc(struct arena *a, size_t size);
+
+/** Copies at most n bytes of s into a null-terminated arena string
+ *
+ *  @sa strndup() */
+char *arena_strndup(struct arena *a, char const *s, size_t n);
+
+/** Copies s into an arena string
+ *
+ *  @sa strdup() */
+char *arena_strdup(struct arena *a, char const *s);
+
+/** Frees every allocation made from the arena, leaving it empty */
+void arena_release(struct arena *a);
@@ -0,0 +1,125 @@
+#include <stddef.h>
+#include <stdint.h>
+
+#include "scan.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define SCAN_VECTOR_SIZE 32
+typedef __m256i scan_vec;
+#define scan_load(p) _mm256_load_si256((scan_vec const *)(p))
+#define scan_splat(c) _mm256_set1_epi8(c)
+#define scan_eq(a, b) _mm256_cmpeq_epi8(a, b)
+#define scan_or(a, b) _mm256_or_si256(a, b)
+#define scan_mask(v) ((uint32_t)_mm256_movemask_epi8(v))
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define SCAN_VECTOR_SIZE 16
+typedef __m128i scan_vec;
+#define scan_load(p) _mm_load_si128((scan_vec const *)(p))
+#define scan_splat(c) _mm_set1_epi8(c)
+#define scan_eq(a, b) _mm_cmpeq_epi8(a, b)
+#define scan_or(a, b) _mm_or_si128(a, b)
+#define scan_mask(v) ((uint32_t)_mm_movemask_epi8(v))
+#endif
+
+/* Byte classes, for the scalar version */
+enum {
+  CLASS_WORD = 1 << 0,
+  CLASS_DQUOTED = 1 << 1,
+  CLASS_SQUOTED = 1 << 2,
+  CLASS_EXPAND = 1 << 3,
+};
+
+#define MAX_SET 11
+
+/* The bytes each function stops at, besides the null byte */
+static char const word_set[] = " \t&;|<>\n\"'\\";
+static char const dquoted_set[] = "\"\\";
+static char const squoted_set[] = "'";
+static char const expand_set[] = "$\"'\\";
+
+#ifdef SCAN_VECTOR_SIZE
+/** Returns the first byte of s in set[0..n), or the null byte */
+static char const *
+scan(char const *s, char const *set, int n)
+{
+  scan_vec needles[MAX_SET];
+  for (int i = 0; i < n; ++i) needles[i] = scan_splat(set[i]);
+  scan_vec const nul = scan_splat(0);
+
+  /* Start from the aligned block holding s, ignoring the bytes before it */
+  uintptr_t const offset = (uintptr_t)s % SCAN_VECTOR_SIZE;
+  char const *p = s - offset;
+  uint32_t skip = offset;
+  for (;; p += SCAN_VECTOR_SIZE, skip = 0) {
+    scan_vec const v = scan_load(p);
+    scan_vec m = scan_eq(v, nul);
+    for (int i = 0; i < n; ++i) m = scan_or(m, scan_eq(v, needles[i]));
+    uint32_t const mask = scan_mask(m) >> skip << skip;
+    if (mask) return p + __builtin_ctz(mask);
+  }
+}
+#else
+static unsigned char const class_table[256] = {
+    [' '] = CLASS_WORD,
+    ['\t'] = CLASS_WORD,
+    ['&'] = CLASS_WORD,
+    [';'] = CLASS_WORD,
+    ['|'] = CLASS_WORD,
+    ['<'] = CLASS_WORD,
+    ['>'] = CLASS_WORD,
+    ['\n'] = CLASS_WORD,
+    ['"'] = CLASS_WORD | CLASS_DQUOTED | CLASS_EXPAND,
+    ['\''] = CLASS_WORD | CLASS_SQUOTED | CLASS_EXPAND,
+    ['\\'] = CLASS_WORD | CLASS_DQUOTED | CLASS_EXPAND,
+    ['$'] = CLASS_EXPAND,
+};
+
+static char const *
+scan_scalar(char const *s, unsigned classes)
+{
+  for (; *s && !(class_table[(unsigned char)*s] & classes); ++s);
+  return s;
+}
+#endif
+
+char const *
+scan_word(char const *s)
+{
+#ifdef SCAN_VECTOR_SIZE
+  return scan(s, word_set, sizeof word_set - 1);
+#else
+  return scan_scalar(s, CLASS_WORD);
+#endif
+}
+
+char const *
+scan_dquoted(char const *s)
+{
+#ifdef SCAN_VECTOR_SIZE
+  return scan(s, dquoted_set, sizeof dquoted_set - 1);
+#else
+  return scan_scalar(s, CLASS_DQUOTED);
+#endif
+}
+
+char const *
+scan_squoted(char const *s)
+{
+#ifdef SCAN_VECTOR_SIZE
+  return scan(s, squoted_set, sizeof squoted_set - 1);
+#else
+  return scan_scalar(s, CLASS_SQUOTED);
+#endif
+}
+
+char const *
+scan_expand(char const *s)
+{
+#ifdef SCAN_VECTOR_SIZE
+  return scan(s, expand_set, sizeof expand_set - 1);
+#else
+  return scan_scalar(s, CLASS_EXPAND);
+#endif
+}
@@ -0,0 +1,23 @@
+#pragma once
+/** Vectorized scanning for the tokenizer and expander
+ *
+ *  Each function returns a pointer to the first byte of s in its set, or to
+ *  the terminating null byte if there is none.
+ *
+ *  With SSE2 (or AVX2, when compiled for it), 16 (or 32) bytes are classified
+ *  at a time, otherwise a lookup table is used one byte at a time. The vector
+ *  versions may read past the terminating null byte, but never across an
+ *  aligned 16 (or 32) byte boundary, so they can't fault.
+ */
+
+/** blanks, operators (& ; | < > newline), quotes and backslash */
+char const *scan_word(char const *s);
+
+/** double quote and backslash */
+char const *scan_dquoted(char const *s);
+
+/** single quote */
+char const *scan_squoted(char const *s);
+
+/** $, quotes and backslash */
+char const *scan_expand(char const *s);
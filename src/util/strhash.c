@@ -0,0 +1,23 @@
+#include <stdint.h>
+
+#include "strhash.h"
+
+size_t strhash(char const *s)
+{
+  uint64_t h = 14695981039346656037u;
+  for (; *s; ++s) {
+    h ^= (unsigned char)*s;
+    h *= 1099511628211u;
+  }
+  return (size_t)h;
+}
+
+uint64_t memhash(void const *p, size_t n, uint64_t h)
+{
+  unsigned char const *s = p;
+  for (size_t i = 0; i < n; ++i) {
+    h ^= s[i];
+    h *= 1099511628211u;
+  }
+  return h;
+}
@@ -0,0 +1,25 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+/** Hashes a null-terminated string
+ *
+ *  @param s[in] string to hash
+ *  @returns 64-bit FNV-1a hash of s, truncated to size_t
+ *
+ *  Used to index the shell's internal hash tables.
+ */
+size_t strhash(char const *s);
+
+/** Initial value for memhash() */
+#define MEMHASH_INIT UINT64_C(14695981039346656037)
+
+/** Continues a 64-bit FNV-1a hash over n bytes
+ *
+ *  @param p[in] bytes to hash
+ *  @param h hash of the preceding bytes, or MEMHASH_INIT
+ *  @returns the updated hash
+ *
+ *  Lets a large input be hashed one block at a time.
+ */
+uint64_t memhash(void const *p, size_t n, uint64_t h);
@@ -7,17 +7,39 @@
 #include <string.h>
 #include <unistd.h>
 
+#include "cmdhash.h"
 #include "util/gprintf.h"
+#include "util/strhash.h"
 #include "vars.h"
 
 struct var {
-  struct var *next;
+  size_t hash; /* strhash(name) */
   bool export : 1;
   char *value;
   char name[];
 };
 
-static struct var *var_list = 0;
+/* Open-addressing hash table of vars, with linear probing. The size is always
+ * a power of two, and is doubled to keep the table at most half full. Empty
+ * slots are null pointers; there are no tombstones, since remove_var() shifts
+ * displaced records back instead. */
+static struct var **var_table = 0;
+static size_t var_table_size = 0;
+static size_t var_count = 0;
+
+extern char **environ;
+
+/* The shell's environment is kept in the var table, imported from environ the
+ * first time variables are used. Entries whose names aren't valid variable
+ * names can't be stored there, so they are passed through untouched. */
+static bool environ_loaded = 0;
+static char **foreign_env = 0;
+static size_t foreign_env_count = 0;
+
+/* The environment for child processes, rebuilt by vars_environ() only after
+ * an exported variable has changed */
+static char **env_block = 0;
+static bool env_dirty = 1;
 
 /** Checks if a variable name is a valid XBD name 
  *
@@ -69,6 +91,43 @@ vars_is_valid_varname(char const *name)
   return is_valid_varname(name);
 }
 
+/** returns the slot holding name, or the empty slot where it would go
+ *
+ * The table must not be empty.
+ */
+static size_t
+find_slot(char const *name, size_t hash)
+{
+  size_t const mask = var_table_size - 1;
+  size_t i = hash & mask;
+  for (; var_table[i]; i = (i + 1) & mask) {
+    if (var_table[i]->hash == hash && strcmp(var_table[i]->name, name) == 0) {
+      break;
+    }
+  }
+  return i;
+}
+
+/** doubles the size of the var table, rehashing every var into it */
+static int
+grow_table(void)
+{
+  size_t const new_size = var_table_size ? var_table_size * 2 : 64;
+  struct var **new_table = calloc(new_size, sizeof *new_table);
+  if (!new_table) return -1;
+  for (size_t i = 0; i < var_table_size; ++i) {
+    struct var *v = var_table[i];
+    if (!v) continue;
+    size_t j = v->hash & (new_size - 1);
+    while (new_table[j]) j = (j + 1) & (new_size - 1);
+    new_table[j] = v;
+  }
+  free(var_table);
+  var_table = new_table;
+  var_table_size = new_size;
+  return 0;
+}
+
 /** returns nullptr if not found 
  *
  * XXX DO NOT MODIFY XXX 
@@ -79,13 +138,9 @@ find_var(char const *name)
   assert(name);
   assert(is_valid_varname(name));
 
-  /* Search local varlist */
-  struct var *v = var_list;
-  for (; v; v = v->next) {
-    if (strcmp(v->name, name) == 0) return v;
-  }
-
-  return 0;
+  /* Search local var table */
+  if (!var_count) return 0;
+  return var_table[find_slot(name, strhash(name))];
 }
 
 /** Creates a new var with name and inserts into var list 
@@ -97,19 +152,16 @@ new_var(char const *name)
 {
   assert(is_valid_varname(name));
   assert(!find_var(name));
+  if ((var_count + 1) * 2 > var_table_size && grow_table() < 0) return 0;
   struct var *v = malloc(sizeof *v + strlen(name) + 1);
   if (!v) return 0;
   strcpy(v->name, name);
+  v->hash = strhash(name);
 
-  char *val = getenv(name);
-  if (val) {
-    v->export = 1;
-  } else {
-    v->export = 0;
-  }
+  v->export = 0;
   v->value = 0;
-  v->next = var_list;
-  var_list = v;
+  var_table[find_slot(name, v->hash)] = v;
+  ++var_count;
   return v;
 }
 
@@ -121,16 +173,62 @@ static void
 remove_var(char const *name)
 {
   assert(is_valid_varname(name));
-  struct var **link = &var_list;
-  for (; *link; link = &((*link)->next)) {
-    if (strcmp((*link)->name, name) == 0) {
-      void *tmp = (*link)->next;
-      free((*link)->value);
-      free(*link);
-      *link = tmp;
-      break;
+  if (!var_count) return;
+  size_t const mask = var_table_size - 1;
+  size_t i = find_slot(name, strhash(name));
+  if (!var_table[i]) return;
+  free(var_table[i]->value);
+  free(var_table[i]);
+  var_table[i] = 0;
+  --var_count;
+
+  /* Shift back any records in the probe sequence after the hole whose home
+   * slot isn't cyclically between the hole and where they ended up, so that
+   * lookups never stop early at the new empty slot */
+  for (size_t j = (i + 1) & mask; var_table[j]; j = (j + 1) & mask) {
+    size_t const home = var_table[j]->hash & mask;
+    int const stays = (i < j) ? (i < home && home <= j)
+                              : (i < home || home <= j);
+    if (stays) continue;
+    var_table[i] = var_table[j];
+    var_table[j] = 0;
+    i = j;
+  }
+}
+
+/** Imports the environment the shell was started with into the var table
+ *
+ * Only does anything the first time it is called.
+ */
+static int
+load_environ(void)
+{
+  if (environ_loaded) return 0;
+  environ_loaded = 1;
+  for (char **e = environ; e && *e; ++e) {
+    char *eq = strchr(*e, '=');
+    if (eq) *eq = '\0';
+    int const valid = eq && is_valid_varname(*e);
+    if (valid && !find_var(*e)) {
+      struct var *v = new_var(*e);
+      if (v) v->value = strdup(eq + 1);
+      if (!v || !v->value) goto err;
+      v->export = 1;
     }
+    if (eq) *eq = '=';
+    if (valid) continue;
+
+    void *tmp =
+        realloc(foreign_env, sizeof *foreign_env * (foreign_env_count + 1));
+    if (!tmp) return -1;
+    foreign_env = tmp;
+    foreign_env[foreign_env_count++] = *e;
+    continue;
+  err:
+    if (eq) *eq = '=';
+    return -1;
   }
+  return 0;
 }
 
 /** Return existing var, or make a new var
@@ -154,18 +252,21 @@ vars_set(char const *name, char const *value)
     return -1;
   }
   gprintf("vars_set(%s, %s)", name, value);
+  if (load_environ() < 0) return -1;
+  if (strcmp(name, "PATH") == 0) cmdhash_flush();
 
   struct var *v = ensure_var(name);
   if (!v) return -1;
 
-  if (v->export) {
-    gprintf("%s=%s is exported, updating env", name, value);
-    return setenv(name, value, 1);
-  }
-
   char *dupval = strdup(value);
   if (!dupval) return -1;
+  free(v->value);
   v->value = dupval;
+
+  if (v->export) {
+    gprintf("%s=%s is exported, updating env", name, value);
+    env_dirty = 1;
+  }
   return 0;
 }
 
@@ -178,20 +279,14 @@ vars_get(char const *name)
     return 0;
   }
 
-  gprintf("searching for %s in local var list", name);
-  /* Look through our local var list */
-  struct var *v = find_var(name);
-  if (v && !v->export) {
-    gprintf("found local var %s with value %s", name, v->value);
-    return v->value;
-  }
+  if (load_environ() < 0) return 0;
 
-  gprintf("searching for %s in environment", name);
-  /* Fallback to searching environment */
-  char const *value = getenv(name);
+  gprintf("searching for %s in var table", name);
+  struct var *v = find_var(name);
+  char const *value = v ? v->value : 0;
 #ifndef NDEBUG
   if (value) {
-    gprintf("found env var %s with value %s", name, value);
+    gprintf("found var %s with value %s", name, value);
   } else {
     gprintf("did not find var %s", name);
   }
@@ -208,8 +303,12 @@ vars_unset(char const *name)
     return -1;
   }
   gprintf("unsetting var %s", name);
+  if (load_environ() < 0) return -1;
+  if (strcmp(name, "PATH") == 0) cmdhash_flush();
+  struct var *v = find_var(name);
+  if (v && v->export) env_dirty = 1;
   remove_var(name);
-  return unsetenv(name);
+  return 0;
 }
 
 /* XXX DO NOT MODIFY XXX */
@@ -221,30 +320,82 @@ vars_export(char const *name)
     return -1;
   }
   gprintf("marking %s for export", name);
+  if (load_environ() < 0) return -1;
   struct var *v = ensure_var(name);
   if (!v) return -1;
 
-  /* Mark exported */
-  v->export = 1;
-
   /* Only actually export to env if already set */
-  if (v->value) {
+  if (v->value && !v->export) {
     gprintf("exporting value %s for var %s", v->value, name);
-    if (setenv(v->name, v->value, 1) < 0) {
-      return -1;
-    }
+    env_dirty = 1;
   }
+
+  /* Mark exported */
+  v->export = 1;
   return 0;
 }
 
+char **
+vars_environ(void)
+{
+  if (load_environ() < 0) return 0;
+  if (!env_dirty) return env_block;
+
+  /* One allocation holds the pointer array followed by the strings */
+  size_t count = foreign_env_count;
+  size_t size = 0;
+  for (size_t i = 0; i < var_table_size; ++i) {
+    struct var const *v = var_table[i];
+    if (!v || !v->export || !v->value) continue;
+    ++count;
+    size += strlen(v->name) + strlen(v->value) + 2;
+  }
+  char **block = malloc(sizeof *block * (count + 1) + size);
+  if (!block) return 0;
+
+  char **out = block;
+  char *str = (char *)(block + count + 1);
+  for (size_t i = 0; i < foreign_env_count; ++i) *out++ = foreign_env[i];
+  for (size_t i = 0; i < var_table_size; ++i) {
+    struct var const *v = var_table[i];
+    if (!v || !v->export || !v->value) continue;
+    *out++ = str;
+    size_t len = strlen(v->name);
+    memcpy(str, v->name, len);
+    str += len;
+    *str++ = '=';
+    len = strlen(v->value) + 1;
+    memcpy(str, v->value, len);
+    str += len;
+  }
+  *out = 0;
+
+  gprintf("rebuilt environment with %zu entries", count);
+  free(env_block);
+  env_block = block;
+  env_dirty = 0;
+  return env_block;
+}
+
 /* XXX DO NOT MODIFY XXX */
 void
 vars_cleanup(void)
 {
-  while (var_list) {
-    struct var *v = var_list;
-    var_list = v->next;
-    free(v->value);
-    free(v);
+  for (size_t i = 0; i < var_table_size; ++i) {
+    if (!var_table[i]) continue;
+    free(var_table[i]->value);
+    free(var_table[i]);
   }
+  free(var_table);
+  var_table = 0;
+  var_table_size = 0;
+  var_count = 0;
+
+  free(foreign_env);
+  foreign_env = 0;
+  foreign_env_count = 0;
+  free(env_block);
+  env_block = 0;
+  env_dirty = 1;
+  environ_loaded = 0;
 }
@@ -48,6 +48,18 @@ int vars_unset(char const *name);
  */
 int vars_export(char const *name);
 
+/** gets the environment for a child process
+ *  @returns null-terminated array of "name=value" strings
+ *  @returns null pointer on error and sets `errno` (see exceptions)
+ *
+ *  @exception ENOMEM not enough memory to build the environment
+ *
+ *  Holds every exported variable that has a value. The shell's own environ is
+ *  left alone; children are given this array instead. It is only rebuilt
+ *  after an exported variable changes, and remains valid until then.
+ */
+char **vars_environ(void);
+
 /** predicate for checking if a variable name is valid
  *  @returns 1 if valid
  *  @returns 0 if invalid
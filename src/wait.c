@@ -10,6 +10,7 @@
 #include "jobs.h"
 #include "params.h"
 #include "parser.h"
+#include "signal.h"
 #include "wait.h"
 
 int
@@ -29,10 +30,13 @@ wait_on_fg_pgid(pid_t const pgid)
     //   process group whose ID is -pid (Linux manpage)
   
   // BG added; double check this 11/21
-  pid_t terminal_pgid = tcgetpgrp(STDIN_FILENO);
-  if (terminal_pgid < 0)  return -1;
+  /* Only an interactive shell has a controlling terminal to hand over */
+  pid_t terminal_pgid = -1;
 
   if (is_interactive) {
+    terminal_pgid = tcgetpgrp(STDIN_FILENO);
+    if (terminal_pgid < 0) return -1;
+
     /* BGDID make 'pgid' the foreground process group
      * XXX review tcsetpgrp(3) */
     if (tcsetpgrp(STDIN_FILENO, pgid) < 0) return -1; 
@@ -101,6 +105,7 @@ wait_on_fg_pgid(pid_t const pgid)
 
     /* Record status for reporting later when we see ECHILD */
     if (jobs_set_status(jid, status) < 0) goto err;
+    if (!WIFSTOPPED(status)) jobs_remove_pid(res);
 
     /* BGDID to handle case where a child process is stopped
      *  The entire process group is placed in the background (how is that being taken care of??)
@@ -146,54 +151,43 @@ wait_on_fg_job(jid_t jid)
 int
 wait_on_bg_jobs()
 {
-  size_t job_count = jobs_get_joblist_size();
-  struct job const *jobs = jobs_get_joblist();
-  for (size_t i = 0; i < job_count; ++i) {
-    pid_t pgid = jobs[i].pgid;
-    jid_t jid = jobs[i].jid;
-    for (;;) {
-      /* BGDID: Modify the following line to wait for process group
-       * XXX make sure to do a nonblocking wait!
-       */
-      int status;
-      pid_t pid = waitpid(-pgid, &status, WNOHANG);
-        /* 
-        * waitpid(): on success, returns the process ID of the child whose state has changed; 
-        * if WNOHANG was specified and one or more child(ren) specified by pid exist, 
-        * but have not yet changed state, then 0 is returned. 
-        * On error, -1 is returned.
-        */
-      if (pid == 0) {
-        /* Unwaited children that haven't exited */
+  /* Jobs only finish with a SIGCHLD, so most prompts have nothing to do */
+  if (!signal_sigchld_pending()) return 0;
+  signal_sigchld_clear();
+
+  /* Collect just the children that changed state, whatever their job */
+  for (;;) {
+    int status;
+    pid_t pid = waitpid(-1, &status, WNOHANG);
+    if (pid == 0) {
+      /* Unwaited children that haven't exited */
+      break;
+    } else if (pid < 0) {
+      /* Error -- some errors are ok though! */
+      if (errno == ECHILD) {
+        /* No children at all */
+        errno = 0;
         break;
-      } else if (pid < 0) {
-        /* Error -- some errors are ok though! */
-        if (errno == ECHILD) {
-          /* No children -- print saved exit status */
-          errno = 0;
-          if (jobs_get_status(jid, &status) < 0) return -1;
-          if (WIFEXITED(status)) {
-            fprintf(stderr, "[%jd] Done\n", (intmax_t)jid);
-          } else if (WIFSIGNALED(status)) {
-            fprintf(stderr, "[%jd] Terminated\n", (intmax_t)jid);
-          }
-          jobs_remove_pgid(pgid);
-          job_count = jobs_get_joblist_size();
-          jobs = jobs_get_joblist();
-          break;
-        }
-        return -1; /* Other errors are not ok */
       }
+      return -1; /* Other errors are not ok */
+    }
 
-      /* Record status for reporting later when we see ECHILD */
-      if (jobs_set_status(jid, status) < 0) return -1;
+    pid_t pgid = jobs_get_pid_pgid(pid);
+    jid_t jid = jobs_get_jid(pgid);
+    if (jid < 0) continue; /* Not one of our jobs' processes */
 
-      /* Handle case where a process in the group is stopped */
-      if (WIFSTOPPED(status)) {
-        fprintf(stderr, "[%jd] Stopped\n", (intmax_t)jid);
-        break;
-      }
+    /* Record status for reporting once the last process is gone */
+    if (jobs_set_status(jid, status) < 0) return -1;
+    if (jobs_remove_pid(pid) > 0) continue;
+
+    /* That was the job's last process -- print saved exit status */
+    if (jobs_get_status(jid, &status) < 0) return -1;
+    if (WIFEXITED(status)) {
+      fprintf(stderr, "[%jd] Done\n", (intmax_t)jid);
+    } else if (WIFSIGNALED(status)) {
+      fprintf(stderr, "[%jd] Terminated\n", (intmax_t)jid);
     }
+    jobs_remove_pgid(pgid);
   }
   return 0;
 }